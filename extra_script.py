@@ -11,3 +11,38 @@ print(teensy_dir)
 # copy everything from overrides/teensy4/* to framework dir
 for file in glob.glob(os.path.join('overrides', 'teensy4', '*')):
     shutil.copy(file, teensy_dir)
+
+# usb.c stalls HID GET_REPORT for the joystick, hand it to
+# usb_joystick_get_report() instead. The case goes in at the top of the
+# setup request switch, so it works on any core that still has that switch.
+GET_REPORT_MARK = '// buttonbox: HID GET_REPORT'
+GET_REPORT_CASE = '''
+	  case 0x01A1: %s, see usb_joystick.c
+#ifdef JOYSTICK_INTERFACE
+		if (setup.wIndex == JOYSTICK_INTERFACE) {
+			uint32_t len;
+			const void *report = usb_joystick_get_report(setup.wValue, &len);
+			if (report) {
+				endpoint0_transmit(report,
+					len < setup.wLength ? len : setup.wLength, 0);
+				return;
+			}
+		}
+#endif
+		break;''' % GET_REPORT_MARK
+
+usb_c = os.path.join(teensy_dir, 'usb.c')
+with open(usb_c) as f:
+    source = f.read()
+anchor = 'switch (setup.wRequestAndType) {'
+if GET_REPORT_MARK in source:
+    pass
+elif anchor not in source or 'case 0x01A1:' in source:
+    print('warning: usb.c does not look as expected, HID GET_REPORT is '
+          'left to the core')
+else:
+    source = source.replace('#include "usb_dev.h"',
+                            '#include "usb_dev.h"\n#include "usb_joystick.h"', 1)
+    source = source.replace(anchor, anchor + GET_REPORT_CASE, 1)
+    with open(usb_c, 'w') as f:
+        f.write(source)
@@ -0,0 +1,60 @@
+#ifndef ANALOG_PORT_H
+#define ANALOG_PORT_H
+
+#include <Arduino.h>
+
+#include "axis_filter.h"
+
+/**
+ * Analog axes: each ADC converts one pin at a fixed rate, triggered by its
+ * own timer, and DMA fills a ping-pong buffer. A full buffer is one
+ * decimated sample (the sum of AXIS_OVERSAMPLE conversions), which runs
+ * through the axis filter from loop().
+ *
+ * Build with -D BUTTONBOX_AXES=<n> (n = 1 or 2, one per ADC) together with a
+ * report that carries axes, -D BUTTONBOX_REPORT_IDS or
+ * -D BUTTONBOX_EXTREME_JOYSTICK.
+ */
+
+#ifdef BUTTONBOX_AXES
+#define AXIS_COUNT BUTTONBOX_AXES
+#else
+#define AXIS_COUNT 0
+#endif
+
+static_assert(AXIS_COUNT <= 2, "one axis per ADC");
+
+#ifndef AXIS_0_PIN
+#define AXIS_0_PIN A0
+#endif
+
+#ifndef AXIS_1_PIN
+#define AXIS_1_PIN A1
+#endif
+
+#ifndef AXIS_SAMPLE_HZ
+#define AXIS_SAMPLE_HZ 16000
+#endif
+
+/**
+ * Without BUTTONBOX_AXES everything here compiles to nothing.
+ */
+class AnalogPort {
+public:
+#if AXIS_COUNT > 0
+  void begin();
+  void poll();
+  const AxisFilter &filter(uint8_t axis) const { return filters[axis]; }
+  uint32_t reports = 0;
+
+private:
+  AxisFilter filters[AXIS_COUNT];
+#else
+  void begin() {}
+  void poll() {}
+#endif
+};
+
+extern AnalogPort analogPort;
+
+#endif // ANALOG_PORT_H
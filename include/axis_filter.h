@@ -0,0 +1,97 @@
+#ifndef AXIS_FILTER_H
+#define AXIS_FILTER_H
+
+#include <stdint.h>
+
+// fraction bits of the filter state
+#define AXIS_FILTER_FRACTION 8
+
+// conversions per decimated sample, 16 x 12 bit sums up to 16 bits
+#define AXIS_OVERSAMPLE 16
+
+#ifndef AXIS_SMOOTHING
+#define AXIS_SMOOTHING 3
+#endif
+
+#ifndef AXIS_DEADBAND
+#define AXIS_DEADBAND 512
+#endif
+
+#ifndef AXIS_HYSTERESIS
+#define AXIS_HYSTERESIS 64
+#endif
+
+/**
+ * Filter settings of one axis, all in decimated 16 bit sample units.
+ */
+struct AxisConfig {
+  uint8_t smoothing;   // IIR weight of a new sample is 1 / 2^smoothing
+  uint16_t low;        // everything below reads as 0 (end deadband)
+  uint16_t high;       // everything above reads as 65535
+  uint16_t hysteresis; // output only follows moves larger than this
+};
+
+// what every axis starts with, from the tunables above
+const AxisConfig AXIS_DEFAULT_CONFIG = {AXIS_SMOOTHING, AXIS_DEADBAND,
+                                        65535 - AXIS_DEADBAND,
+                                        AXIS_HYSTERESIS};
+
+/**
+ * Turns decimated ADC samples into an axis position. A single pole IIR in
+ * fixed point smooths the samples, the deadbands stretch the usable travel
+ * to the full 16 bit range and the hysteresis holds the output until the
+ * filtered value really moved, so a pot sitting still sends nothing.
+ * Every step is integer math with one multiply.
+ */
+struct AxisFilter {
+  AxisConfig config = {};
+  uint32_t scale = 0;  // 65535 / (high - low) in 16.16
+  int32_t state = 0;   // filtered sample with AXIS_FILTER_FRACTION bits
+  uint16_t output = 0; // position last reported
+
+  void configure(const AxisConfig &c) {
+    config = c;
+    uint32_t span = c.high > c.low ? c.high - c.low : 1;
+    scale = (65535UL << 16) / span;
+  }
+
+  void reset(uint16_t sample) {
+    state = int32_t(sample) << AXIS_FILTER_FRACTION;
+    output = position();
+  }
+
+  uint16_t filtered() const { return state >> AXIS_FILTER_FRACTION; }
+
+  uint16_t position() const {
+    uint16_t f = filtered();
+    if (f <= config.low) {
+      return 0;
+    }
+    if (f >= config.high) {
+      return 65535;
+    }
+    uint32_t p = (uint64_t(f - config.low) * scale) >> 16;
+    return p < 65535 ? p : 65535;
+  }
+
+  /**
+   * Adds one decimated sample, returns true when the output moved and a
+   * report should go out.
+   */
+  bool update(uint16_t sample) {
+    int32_t x = int32_t(sample) << AXIS_FILTER_FRACTION;
+    state += (x - state) >> config.smoothing;
+
+    uint16_t p = position();
+    uint16_t delta = p > output ? p - output : output - p;
+    // the ends are always reachable, whatever the hysteresis says
+    bool end = (p == 0 || p == 65535) && p != output;
+    if (delta <= config.hysteresis && !end) {
+      return false;
+    }
+    output = p;
+    return true;
+  }
+};
+
+#endif // AXIS_FILTER_H
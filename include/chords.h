@@ -0,0 +1,82 @@
+#ifndef CHORDS_H
+#define CHORDS_H
+
+#include <stdint.h>
+
+#include "layout.h"
+#include "pipeline.h"
+
+/**
+ * Chords: two or more inputs held together give a virtual button of their
+ * own. Chords are defined by the button ids of their inputs and resolved to
+ * slot masks whenever a layout becomes active, so a match is one AND and
+ * compare per word and chord against the packed state.
+ *
+ * With suppression on, a press of an input that belongs to any chord is held
+ * back for up to CHORD_WINDOW_MS. If the chord completes in that window the
+ * sim only sees the chord button, otherwise the held back presses go out
+ * late. An input released inside the window still gives a tap.
+ *
+ * Either way a chord only completes from presses inside one window, which
+ * starts with the first of them: an input held down for longer has already
+ * been sent as itself and starts no chord with what is pressed later.
+ */
+
+#ifndef CHORD_MAX
+#define CHORD_MAX 16
+#endif
+
+#define CHORD_MAX_KEYS 4
+
+#ifndef CHORD_WINDOW_MS
+#define CHORD_WINDOW_MS 50
+#endif
+
+static_assert(CHORD_MAX <= 32, "active chords are a 32 bit mask");
+
+struct ChordDef {
+  uint8_t button;                 // virtual button of the chord
+  uint8_t keys[CHORD_MAX_KEYS];   // button ids of the inputs, 0 = unused
+};
+
+class ChordMatcher {
+public:
+  void define(const ChordDef *defs, uint8_t count);
+  void begin(ButtonSink &sink) { this->sink = &sink; }
+  void configure(const LayoutTable &t);
+  void end();
+
+  /**
+   * Takes the debounced presses and releases of one scan and removes what
+   * the chords swallow or hold back, adding presses that were held back.
+   */
+  void filter(uint64_t *down, uint64_t *up, const uint64_t *stable);
+  bool waiting() const { return holding; }
+
+  uint16_t windowMs = CHORD_WINDOW_MS;
+  bool suppress = true;
+  uint32_t matched = 0;
+  uint32_t timeouts = 0;
+
+private:
+  void match(const uint64_t *stable);
+
+  const ChordDef *defs = nullptr;
+  uint8_t count = 0;
+  uint8_t chords = 0; // resolved, leading entries of mask/button
+  uint64_t mask[CHORD_MAX][INPUT_WORDS];
+  uint8_t button[CHORD_MAX];
+  uint64_t members[INPUT_WORDS];  // inputs that belong to any chord
+  uint64_t pending[INPUT_WORDS];  // presses held back in the window
+  uint64_t consumed[INPUT_WORDS]; // inputs held down as part of a chord
+  uint64_t late[INPUT_WORDS];     // taps whose release goes out next scan
+  uint64_t fresh[INPUT_WORDS];    // member presses inside the window
+  uint32_t active = 0;            // bit per chord that is down
+  uint32_t windowStart = 0;
+  bool holding = false;
+  ButtonSink *sink = nullptr;
+};
+
+extern ChordMatcher chords;
+
+#endif // CHORDS_H
@@ -0,0 +1,59 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdint.h>
+
+#include "layout_store.h"
+#include "stats.h"
+
+#ifndef CONSOLE_BUDGET_US
+#define CONSOLE_BUDGET_US 5
+#endif
+
+#define CONSOLE_LINE_LENGTH 64
+#define CONSOLE_OUT_LENGTH 96
+
+/**
+ * Line based command console on the USB serial port. It is polled from
+ * loop() and never blocks: input is consumed byte by byte until the time
+ * budget runs out, and long answers are produced one line per poll and only
+ * written when the serial buffer has room for the whole line.
+ */
+class Console {
+public:
+  void poll();
+
+private:
+  // multi line answers in progress
+  enum Job : uint8_t {
+    JOB_NONE,
+    JOB_HELP,
+    JOB_STATS,
+    JOB_REPORT,
+    JOB_INTERVALS,
+    JOB_MACROS,
+    JOB_INPUTS,
+    JOB_LATENCY,
+    JOB_TASKS,
+    JOB_CAPTURE
+  };
+
+  void receive(char c);
+  void execute();
+  void start(Job job);
+  bool next();
+  bool histogramLine(const Histogram &h, const char *unit, uint8_t first);
+  void reply(const char *fmt, ...);
+
+  char line[CONSOLE_LINE_LENGTH];
+  uint8_t lineLength = 0;
+  char out[CONSOLE_OUT_LENGTH];
+  uint8_t outLength = 0;
+  Job job = JOB_NONE;
+  uint16_t step = 0;
+  LayoutReceiver layoutReceiver;
+};
+
+extern Console console;
+
+#endif // CONSOLE_H
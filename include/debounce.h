@@ -0,0 +1,101 @@
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+
+// bit planes of the per-input sample counter, so at most 15 samples
+#define DEBOUNCE_PLANES 4
+#define DEBOUNCE_MAX_SAMPLES ((1 << DEBOUNCE_PLANES) - 1)
+
+/**
+ * Debounces 64 inputs at once. Every bit has a small counter of consecutive
+ * samples that disagree with its stable state, stored as vertical bit planes
+ * so one update is a handful of AND/XOR ops regardless of how many inputs
+ * are bouncing. A bit flips once its counter reaches its threshold, which is
+ * bit-sliced the same way so thresholds can differ per input.
+ *
+ * There is a threshold for presses and one for releases, picked per bit by
+ * its stable state, and eager bits take a press on its first sample. Inputs
+ * are in their pressed state 1 here, the pipeline normalises them first.
+ *
+ * After every change of an eager bit its samples are ignored for its lockout
+ * count, so the bounce of the contact neither releases it again nor, after
+ * a release, presses it again. A third bit-sliced counter counts the lockout
+ * down. The release is then debounced like any other.
+ */
+struct PackedDebouncer {
+  uint64_t stable = 0;
+  uint64_t count[DEBOUNCE_PLANES] = {};
+  uint64_t press[DEBOUNCE_PLANES] = {};
+  uint64_t release[DEBOUNCE_PLANES] = {};
+  uint64_t lockout[DEBOUNCE_PLANES] = {};
+  uint64_t hold[DEBOUNCE_PLANES] = {}; // lockout samples left
+  uint64_t eager = 0;
+
+  void reset(uint64_t raw) {
+    stable = raw;
+    for (int k = 0; k < DEBOUNCE_PLANES; k++) {
+      count[k] = 0;
+      hold[k] = 0;
+    }
+  }
+
+  static void setPlanes(uint64_t *planes, uint64_t mask, uint8_t samples) {
+    if (samples < 1) {
+      samples = 1;
+    } else if (samples > DEBOUNCE_MAX_SAMPLES) {
+      samples = DEBOUNCE_MAX_SAMPLES;
+    }
+    for (int k = 0; k < DEBOUNCE_PLANES; k++) {
+      planes[k] = (samples >> k) & 1 ? planes[k] | mask : planes[k] & ~mask;
+    }
+  }
+
+  void setThreshold(uint64_t mask, uint8_t pressSamples,
+                    uint8_t releaseSamples) {
+    setPlanes(press, mask, pressSamples);
+    setPlanes(release, mask, releaseSamples);
+  }
+
+  void setLockout(uint64_t mask, uint8_t samples) {
+    setPlanes(lockout, mask, samples);
+  }
+
+  /**
+   * Feeds one sample and returns the bits whose stable state flipped.
+   */
+  uint64_t update(uint64_t raw) {
+    uint64_t locked = 0;
+    for (int k = 0; k < DEBOUNCE_PLANES; k++) {
+      locked |= hold[k];
+    }
+    uint64_t diff = (raw ^ stable) & ~locked;
+    uint64_t carry = diff;
+    uint64_t reached = diff;
+    for (int k = 0; k < DEBOUNCE_PLANES; k++) {
+      uint64_t c = count[k];
+      uint64_t next = (c ^ carry) & diff;
+      carry &= c;
+      count[k] = next;
+      uint64_t threshold = (press[k] & ~stable) | (release[k] & stable);
+      reached &= ~(next ^ threshold);
+    }
+    reached |= diff & eager & ~stable;
+    stable ^= reached;
+    uint64_t borrow = locked;
+    for (int k = 0; k < DEBOUNCE_PLANES; k++) {
+      count[k] &= ~reached;
+      uint64_t h = hold[k];
+      hold[k] = h ^ borrow;
+      borrow &= ~h;
+    }
+    if (reached & eager) {
+      for (int k = 0; k < DEBOUNCE_PLANES; k++) {
+        hold[k] |= lockout[k] & reached & eager;
+      }
+    }
+    return reached;
+  }
+};
+
+#endif // DEBOUNCE_H
@@ -0,0 +1,38 @@
+#ifndef DEBOUNCE_PROFILES_H
+#define DEBOUNCE_PROFILES_H
+
+#include <stdint.h>
+
+#include "layout.h"
+
+/**
+ * The debounce settings the default layout is built with, shared with the
+ * host tools so they debounce like the firmware does.
+ */
+
+// the global debounce time, windows of 0 in a profile take it
+#ifndef DEBOUNCE_MS
+#define DEBOUNCE_MS 5
+#endif
+
+// how long an encoder detent holds its button
+#ifndef ENCODER_PULSE_MS
+#define ENCODER_PULSE_MS 20
+#endif
+
+// debounce per input class, entries pick one of these by index. Windows in
+// ms, 0 = the global debounce time, eager ones lock out for the press window
+enum Profile : uint8_t {
+  PROFILE_MATRIX, // matrix keys, the global time
+  PROFILE_PUSH,   // the big push button, pressed on the first edge
+  PROFILE_TOGGLE, // toggle poles and their centres, slow and noisy
+  PROFILE_CLICK,  // encoder clicks, bounce a lot when let go
+};
+const DebounceProfile DEBOUNCE_PROFILES[LAYOUT_PROFILES] = {
+    {0, 0, 0},
+    {0, 5, DEBOUNCE_EAGER},
+    {10, 10, 0},
+    {0, 10, DEBOUNCE_EAGER},
+};
+
+#endif // DEBOUNCE_PROFILES_H
@@ -0,0 +1,121 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <stdint.h>
+
+// wheel size in ticks, a power of two; longer delays go round several times
+#define DEFERRED_SLOTS 64
+
+#ifndef DEFERRED_CAPACITY
+#define DEFERRED_CAPACITY 64
+#endif
+
+#define DEFERRED_NONE 0xFF
+
+static_assert(DEFERRED_CAPACITY < DEFERRED_NONE, "events are indexed by byte");
+
+typedef void (*DeferredFn)(uint16_t arg);
+
+/**
+ * Timing wheel for short delayed actions such as encoder pulse trains.
+ * Events live in a fixed pool and are chained per wheel slot through byte
+ * indexes, so scheduling and firing are O(1) and nothing is allocated.
+ * A tick is whatever unit advance() is fed with, milliseconds here.
+ */
+template <uint8_t Capacity> class DeferredQueue {
+public:
+  DeferredQueue() {
+    for (uint8_t i = 0; i < Capacity; i++) {
+      events[i].next = i + 1 < Capacity ? i + 1 : DEFERRED_NONE;
+    }
+    for (uint8_t s = 0; s < DEFERRED_SLOTS; s++) {
+      slots[s] = DEFERRED_NONE;
+    }
+    freeList = 0;
+  }
+
+  void begin(uint32_t now) { tick = now; }
+  uint8_t used() const { return inUse; }
+  uint32_t now() const { return tick; }
+
+  /**
+   * Runs fn(arg) delay ticks from the last advance(), at least one tick
+   * later. Returns false and counts an overflow when the pool is empty.
+   */
+  bool schedule(uint32_t delay, DeferredFn fn, uint16_t arg) {
+    uint8_t i = freeList;
+    if (i == DEFERRED_NONE) {
+      overflows++;
+      return false;
+    }
+    freeList = events[i].next;
+    inUse++;
+
+    if (delay == 0) {
+      delay = 1;
+    }
+    Event &e = events[i];
+    e.fn = fn;
+    e.arg = arg;
+    e.rounds = (delay - 1) / DEFERRED_SLOTS;
+    uint8_t s = (tick + delay) & (DEFERRED_SLOTS - 1);
+    e.next = slots[s];
+    slots[s] = i;
+    return true;
+  }
+
+  /**
+   * Fires everything that is due up to now and returns how many fired.
+   * Callbacks may schedule again.
+   */
+  uint8_t advance(uint32_t now) {
+    uint8_t fired = 0;
+    while (int32_t(now - tick) > 0) {
+      tick++;
+      uint8_t s = tick & (DEFERRED_SLOTS - 1);
+      uint8_t i = slots[s];
+      slots[s] = DEFERRED_NONE;
+      while (i != DEFERRED_NONE) {
+        Event &e = events[i];
+        uint8_t next = e.next;
+        if (e.rounds) {
+          e.rounds--;
+          e.next = slots[s];
+          slots[s] = i;
+        } else {
+          DeferredFn fn = e.fn;
+          uint16_t arg = e.arg;
+          e.next = freeList;
+          freeList = i;
+          inUse--;
+          fired++;
+          fn(arg);
+        }
+        i = next;
+      }
+    }
+    return fired;
+  }
+
+  uint32_t overflows = 0;
+
+private:
+  struct Event {
+    DeferredFn fn;
+    uint16_t arg;
+    uint8_t next;
+    uint8_t rounds;
+  };
+
+  Event events[Capacity];
+  uint8_t slots[DEFERRED_SLOTS];
+  uint8_t freeList;
+  uint8_t inUse = 0;
+  uint32_t tick = 0;
+};
+
+typedef DeferredQueue<DEFERRED_CAPACITY> Deferred;
+
+extern Deferred deferred;
+
+#endif // DEFERRED_H
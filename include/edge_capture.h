@@ -0,0 +1,59 @@
+#ifndef EDGE_CAPTURE_H
+#define EDGE_CAPTURE_H
+
+#include <Arduino.h>
+
+// 8 bytes each, in DMAMEM so the capture does not eat into DTCM
+#ifndef CAPTURE_RECORDS
+#define CAPTURE_RECORDS 4096
+#endif
+
+#define CAPTURE_MAX_PINS 8
+
+/**
+ * Raw edge capture for characterising switch bounce. Selected direct pins
+ * get a pin change interrupt that stores the cycle counter and the level
+ * of every edge, undebounced, until the buffer is full. The scan keeps
+ * polling the same pins as usual. The console dumps the records in bulk and
+ * tools/bounce.cpp turns them into bounce statistics per input class.
+ */
+struct EdgeRecord {
+  uint32_t cycles;
+  uint8_t slot;
+  uint8_t level; // pin level after the edge, 1 = high
+  uint16_t reserved;
+};
+
+class EdgeCapture {
+public:
+  uint8_t start(const uint8_t *slots, uint8_t count);
+  void stop();
+  void edge(uint8_t n);
+
+  bool running() const { return active; }
+  uint8_t pinCount() const { return armed; }
+  uint8_t slot(uint8_t n) const { return pins[n].slot; }
+  uint16_t count() const { return used; }
+  const EdgeRecord &record(uint16_t i) const;
+  uint32_t lost() const { return overflows; }
+
+  static const char *className(uint8_t slot);
+
+private:
+  struct Pin {
+    volatile uint32_t *port;
+    uint32_t mask;
+    uint8_t pin;
+    uint8_t slot;
+  };
+
+  Pin pins[CAPTURE_MAX_PINS];
+  uint8_t armed = 0; // pins of the last capture, also after stop()
+  bool active = false;
+  volatile uint16_t used = 0;
+  volatile uint32_t overflows = 0;
+};
+
+extern EdgeCapture edgeCapture;
+
+#endif // EDGE_CAPTURE_H
@@ -0,0 +1,48 @@
+#ifndef ENCODER_PORT_H
+#define ENCODER_PORT_H
+
+#include <Arduino.h>
+
+#include "pulse_train.h"
+#include "quadrature.h"
+#include "stats.h"
+
+/**
+ * The rotary encoders of the layout. Pin changes are decoded in the
+ * interrupt, which also turns the time since the previous detent into a
+ * number of logical steps; the loop side plays those steps on the pulse
+ * trains of pulse_train.h.
+ */
+class EncoderPort {
+public:
+  void begin();
+  void poll();
+  void edge(uint8_t n);
+
+  uint8_t encoders() const { return count; }
+  DetentFilter &filter(uint8_t n) { return channels[n].filter; }
+
+  uint32_t detents = 0;
+  uint32_t steps = 0;
+  Histogram intervals; // us between two transitions, all encoders
+
+private:
+  struct Channel {
+    volatile uint32_t *portA;
+    volatile uint32_t *portB;
+    uint32_t maskA;
+    uint32_t maskB;
+    uint8_t slot;
+    QuadratureDecoder decoder;
+    DetentFilter filter;
+    volatile int16_t pending; // signed steps not yet taken by poll()
+    volatile int16_t fast;    // the same for the fast buttons
+  };
+
+  Channel channels[MAX_ROTARY_ENCODERS];
+  uint8_t count = 0;
+};
+
+extern EncoderPort encoderPort;
+
+#endif // ENCODER_PORT_H
@@ -0,0 +1,79 @@
+#ifndef EXPANDER_PORT_H
+#define EXPANDER_PORT_H
+
+#include <Arduino.h>
+
+#include "mcp23017.h"
+
+// the chips share one open drain INT line on this pin
+#ifndef MCP23017_INT_PIN
+#define MCP23017_INT_PIN 8
+#endif
+
+#ifndef MCP23017_I2C_HZ
+#define MCP23017_I2C_HZ 1000000
+#endif
+
+// Wire is LPI2C1 (pins 18/19), Wire1 LPI2C3 (17/16) and Wire2 LPI2C4
+// (25/24); set the pins along with the bus
+#ifndef MCP23017_WIRE
+#define MCP23017_WIRE Wire
+#define MCP23017_LPI2C IMXRT_LPI2C1
+#define MCP23017_SDA_PIN 18
+#define MCP23017_SCL_PIN 19
+#endif
+
+#if MCP23017_CHIPS > 0
+
+/**
+ * Drives the LPI2C command FIFO directly: a read is three command words
+ * (START + address, RECEIVE, STOP) that the peripheral works through on
+ * its own, and poll() only looks at the status and receive FIFO.
+ */
+class Lpi2cBus : public I2cBus {
+public:
+  void startRead(uint8_t address, uint8_t length) override;
+  Status poll(uint8_t *data, uint8_t length) override;
+};
+
+#endif
+
+/**
+ * Device side of the MCP23017 expanders: sets the chips up over Wire at boot,
+ * then only the INT handler and the scan loop touch the bus. Without
+ * BUTTONBOX_MCP23017 everything here compiles to nothing.
+ */
+class ExpanderPort {
+public:
+#if MCP23017_CHIPS > 0
+  void begin();
+  void poll();
+  uint8_t chips() const { return chain.chips(); }
+  uint16_t word(uint8_t chip) const { return chain.word(chip); }
+  void reported() { chain.reported(ARM_DWT_CYCCNT); }
+  const ExpanderChain &stats() const { return chain; }
+  // the bus and INT, a layout entry on one of them is left alone
+  bool ownsPin(uint8_t pin) const {
+    return pin == MCP23017_SDA_PIN || pin == MCP23017_SCL_PIN ||
+           pin == MCP23017_INT_PIN;
+  }
+
+private:
+  static void onInterrupt();
+  void configure(uint8_t chip);
+
+  Lpi2cBus bus;
+  ExpanderChain chain{bus};
+#else
+  void begin() {}
+  void poll() {}
+  uint8_t chips() const { return 0; }
+  uint16_t word(uint8_t chip) const { return 0xFFFF; }
+  void reported() {}
+  bool ownsPin(uint8_t pin) const { return false; }
+#endif
+};
+
+extern ExpanderPort expanderPort;
+
+#endif // EXPANDER_PORT_H
@@ -0,0 +1,30 @@
+#ifndef GATHER_H
+#define GATHER_H
+
+#include <stdint.h>
+
+/**
+ * One input bit to pick out of a port word: which port, which bit of the
+ * port, and which slot of the packed input state it lands in.
+ */
+struct GatherEntry {
+  uint32_t mask;
+  uint8_t port;
+  uint8_t slot;
+};
+
+/**
+ * Collects the pin levels of a set of inputs from port words that were read
+ * in one go, so every GPIO register is read once per scan instead of once per
+ * pin. The bits are OR-ed into raw, which the caller clears beforehand.
+ */
+inline void gatherPorts(const uint32_t *ports, const GatherEntry *table,
+                        uint8_t count, uint64_t *raw) {
+  for (uint8_t i = 0; i < count; i++) {
+    const GatherEntry &g = table[i];
+    uint64_t level = (ports[g.port] & g.mask) != 0;
+    raw[g.slot >> 6] |= level << (g.slot & 63);
+  }
+}
+
+#endif // GATHER_H
@@ -0,0 +1,79 @@
+#ifndef GESTURES_H
+#define GESTURES_H
+
+#include <stdint.h>
+
+#include "layout.h"
+#include "pipeline.h"
+
+/**
+ * Gestures turn one input into up to four buttons: its own button on press
+ * as always, plus virtual buttons for hold, double tap and long press. They
+ * are numbered from button2 of the entry (FLAG_GESTURES):
+ *
+ *   button2       hold, down from GESTURE_HOLD_MS into the press until release
+ *   button2 + 1   double tap, a pulse when pressed again soon after a tap
+ *   button2 + 2   long press, a pulse on release after GESTURE_LONG_MS
+ *
+ * Times come from the deferred timer wheel and timers are never cancelled:
+ * every press and release bumps a per-input generation and a timer that
+ * finds its generation outdated does nothing.
+ *
+ * The three ids go through the active layer like every other button, and
+ * stage() rejects a layout where one of them would not fit. A layer switch
+ * ends every gesture, so a hold is let go in the layer it went down in.
+ */
+
+#ifndef GESTURE_HOLD_MS
+#define GESTURE_HOLD_MS 500
+#endif
+
+#ifndef GESTURE_LONG_MS
+#define GESTURE_LONG_MS 1000
+#endif
+
+#ifndef GESTURE_DOUBLE_MS
+#define GESTURE_DOUBLE_MS 300
+#endif
+
+enum Gesture : uint8_t { GESTURE_HOLD = 0, GESTURE_DOUBLE = 1, GESTURE_LONG = 2 };
+
+class GestureEngine {
+public:
+  void begin(ButtonSink &sink, const InputPipeline &pipeline) {
+    this->sink = &sink;
+    this->pipeline = &pipeline;
+  }
+  void input(uint8_t slot, bool pressed);
+  void end();
+
+  uint16_t holdMs = GESTURE_HOLD_MS;
+  uint16_t longMs = GESTURE_LONG_MS;
+  uint16_t doubleMs = GESTURE_DOUBLE_MS;
+  uint32_t emitted = 0;
+  uint32_t dropped = 0; // pulses lost to a full timer wheel
+
+private:
+  // 6 bytes per input, times are the low 16 bits of the wheel tick
+  struct State {
+    uint16_t pressedAt;
+    uint16_t releasedAt;
+    uint8_t flags;
+    uint8_t generation;
+  };
+
+  enum StateFlags : uint8_t { HELD = 1, HOLDING = 2, TAPPED = 4 };
+
+  static void onHold(uint16_t arg);
+  static void onPulseEnd(uint16_t button);
+  void pulse(uint8_t slot, Gesture g);
+  uint8_t button(uint8_t slot, Gesture g) const;
+
+  State states[LAYOUT_MAX_ENTRIES] = {};
+  ButtonSink *sink = nullptr;
+  const InputPipeline *pipeline = nullptr;
+};
+
+extern GestureEngine gestures;
+
+#endif // GESTURES_H
@@ -0,0 +1,103 @@
+#ifndef INPUT_COUNTERS_H
+#define INPUT_COUNTERS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "layout.h"
+#include "stats.h"
+
+// quiet scans after which the next edge starts a new burst for the latency
+#ifndef INPUT_BURST_GAP
+#define INPUT_BURST_GAP 20
+#endif
+
+/**
+ * Wear and bounce counters per input slot, fed by the pipeline with the
+ * normalised samples and the debounced flips of every scan. Whole words are
+ * compared, so a scan without any edge costs one XOR per word, and every
+ * edge or flip is a plain increment on the slot it happened on.
+ *
+ * An edge is a change of the sampled level between two scans. Edges that do
+ * not end in a debounced change are the bounces the debouncer rejected, the
+ * longest burst is the most edges seen for a single debounced change.
+ *
+ * Every press also adds its latency, the scans from the first edge of its
+ * burst to the debounced press, to one of two histograms, one for eager
+ * inputs and one for those that wait for the contact to settle.
+ */
+struct InputCounter {
+  uint32_t presses;
+  uint32_t edges;
+  uint32_t flips;   // debounced changes, presses and releases
+  uint8_t burst;    // edges since the last debounced change
+  uint8_t longest;  // most edges for one debounced change
+  uint16_t since;   // scan of the first edge of the running burst
+  uint16_t lastEdge;
+  uint16_t reserved;
+
+  // an edge that is still being debounced counts until its flip
+  uint32_t rejected() const { return edges - flips; }
+};
+
+class InputCounters {
+public:
+  void reset(const uint64_t *state) {
+    memcpy(last, state, sizeof(last));
+  }
+
+  void clear() {
+    memset(slots, 0, sizeof(slots));
+    eagerLatency.clear();
+    settledLatency.clear();
+  }
+
+  void sample(const uint64_t *state, const uint64_t *flipped,
+              const uint64_t *stable, const uint64_t *eager) {
+    scans++;
+    for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+      uint64_t edges = state[w] ^ last[w];
+      last[w] = state[w];
+      while (edges) {
+        InputCounter &c = slots[(w << 6) | __builtin_ctzll(edges)];
+        edges &= edges - 1;
+        c.edges++;
+        // a rejected burst never flips, its end is a long enough silence
+        if (c.burst == 0 || uint16_t(scans - c.lastEdge) > INPUT_BURST_GAP) {
+          c.since = scans;
+        }
+        c.lastEdge = scans;
+        c.burst += c.burst < 255;
+      }
+      uint64_t bits = flipped[w];
+      while (bits) {
+        uint8_t bit = __builtin_ctzll(bits);
+        bits &= bits - 1;
+        InputCounter &c = slots[(w << 6) | bit];
+        c.flips++;
+        if ((stable[w] >> bit) & 1) {
+          c.presses++;
+          Histogram &h = (eager[w] >> bit) & 1 ? eagerLatency : settledLatency;
+          h.add(uint16_t(scans - c.since));
+        }
+        c.longest = c.burst > c.longest ? c.burst : c.longest;
+        c.burst = 0;
+      }
+    }
+  }
+
+  const InputCounter &slot(uint8_t slot) const { return slots[slot]; }
+
+  // press latencies in scans
+  Histogram eagerLatency;
+  Histogram settledLatency;
+
+private:
+  InputCounter slots[LAYOUT_MAX_ENTRIES] = {};
+  uint64_t last[INPUT_WORDS] = {};
+  uint16_t scans = 0;
+};
+
+extern InputCounters inputCounters;
+
+#endif // INPUT_COUNTERS_H
@@ -0,0 +1,82 @@
+#ifndef LAYERS_H
+#define LAYERS_H
+
+#include <stdint.h>
+
+/**
+ * Shift layers. Inputs flagged FLAG_LAYER_SELECT in the layout pick a bank
+ * (the first selector is bit 0 of the layer number, the second bit 1) and
+ * every other button id coming out of the layout is translated through the
+ * table of the active layer. The translation is a single indexed load per
+ * event. The selectors keep their own ids, whatever the layer.
+ *
+ * Build with -D BUTTONBOX_LAYERS=<n> (n = 2 or 4) to enable them, usually
+ * together with -D BUTTONBOX_EXTREME_JOYSTICK for 128 buttons. The report is
+ * split evenly, so a layer holds 128 / n ids and a layout using more is
+ * rejected.
+ */
+
+#ifdef BUTTONBOX_LAYERS
+#define LAYER_COUNT BUTTONBOX_LAYERS
+#else
+#define LAYER_COUNT 1
+#endif
+
+#define LAYER_MAX_SELECTORS 2
+
+#if defined(BUTTONBOX_REPORT_IDS) && LAYER_COUNT > 1
+// the upper 64 ids are the encoder section there, a layer would land on them
+#error "layers need BUTTONBOX_EXTREME_JOYSTICK, not BUTTONBOX_REPORT_IDS"
+#endif
+
+static_assert(LAYER_COUNT == 1 || LAYER_COUNT == 2 || LAYER_COUNT == 4,
+              "layers are picked by one or two selector inputs");
+
+// highest button id the report can carry, see usb_desc.h
+#ifndef LAYER_MAX_BUTTON
+#if defined(BUTTONBOX_EXTREME_JOYSTICK) || defined(BUTTONBOX_REPORT_IDS)
+#define LAYER_MAX_BUTTON 128
+#else
+#define LAYER_MAX_BUTTON 56
+#endif
+#endif
+
+// distance between the same physical button in two neighbouring layers, so
+// every layer holds the ids 1..LAYER_STRIDE
+#ifndef LAYER_STRIDE
+#define LAYER_STRIDE (LAYER_MAX_BUTTON / LAYER_COUNT)
+#endif
+
+static_assert(LAYER_COUNT * LAYER_STRIDE <= LAYER_MAX_BUTTON,
+              "every layer has to fit in the report");
+
+// buttons that mean the same in every layer, as a bit mask of ids 1..63
+#ifndef LAYER_GLOBAL_BUTTONS
+#define LAYER_GLOBAL_BUTTONS 0ULL
+#endif
+
+/**
+ * True when a button id comes out of every layer as a button of its own,
+ * anything above the stride would land in the next layer and maps to none.
+ */
+constexpr bool layerFits(int id) {
+  return id <= LAYER_STRIDE || (id < 64 && ((LAYER_GLOBAL_BUTTONS >> id) & 1));
+}
+
+struct LayerMap {
+  uint8_t map[LAYER_COUNT][256];
+
+  constexpr LayerMap() : map() {
+    for (int l = 0; l < LAYER_COUNT; l++) {
+      for (int b = 1; b < 256; b++) {
+        bool global = b < 64 && ((LAYER_GLOBAL_BUTTONS >> b) & 1);
+        int id = global ? b : b + l * LAYER_STRIDE;
+        map[l][b] = layerFits(b) && id <= LAYER_MAX_BUTTON ? id : 0;
+      }
+    }
+  }
+};
+
+constexpr LayerMap LAYER_MAP;
+
+#endif // LAYERS_H
@@ -0,0 +1,165 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "layers.h"
+
+/**
+ * The button layout describes which input feeds which joystick button. It is
+ * a packed binary blob (header + entries) so it can live in EEPROM and be
+ * replaced over serial without reflashing. Entry i always owns bit i of the
+ * packed input state, which makes every lookup a plain array index.
+ */
+
+#define LAYOUT_MAGIC 0x4C42424DUL // "MBBL"
+#define LAYOUT_VERSION 2
+
+#ifndef LAYOUT_MAX_ENTRIES
+#define LAYOUT_MAX_ENTRIES 64
+#endif
+
+// slots and the entry count are bytes
+static_assert(LAYOUT_MAX_ENTRIES <= 255, "a slot must fit in a byte");
+
+#define INPUT_WORDS ((LAYOUT_MAX_ENTRIES + 63) / 64)
+
+#define LAYOUT_NO_PIN 0xFF
+
+#ifndef LAYOUT_MAX_CENTRES
+#define LAYOUT_MAX_CENTRES 8
+#endif
+#define LAYOUT_NO_BUTTON 0
+
+// debounce profiles a layout can define, entries pick one by index
+#define LAYOUT_PROFILES 4
+
+enum InputKind : uint8_t {
+  KIND_NONE = 0,
+  KIND_PUSH = 1,    // momentary switch on a direct pin
+  KIND_TOGGLE = 2,  // latching switch on a direct pin
+  KIND_MATRIX = 3,  // matrix key, pin = row (driven), pin2 = column (read)
+  KIND_ENCODER = 4, // quadrature encoder, pin = A, pin2 = B
+  KIND_EXPANDER = 5, // MCP23017 input, pin = expander pin 0-15, pin2 = chip
+  KIND_SHIFT = 6,    // 74HC165 input, the slot picks the bit of the chain
+  KIND_CENTRE = 7,   // down while neither slot pin nor slot pin2 is
+  KIND_FAST = 8,     // fast buttons of the encoder in slot pin, see FLAG_ACCEL
+  KIND_COUNT
+};
+
+enum LayoutFlags : uint8_t {
+  FLAG_INVERT = 0x01,         // input is active high instead of active low
+  FLAG_QUAD_PRECISION = 0x02, // encoder steps on every quadrature edge
+  FLAG_LAYER_SELECT = 0x04,   // switch picks the button layer, see layers.h
+  FLAG_ACCEL = 0x08,          // encoder steps faster the faster it turns
+  FLAG_GESTURES = 0x10,       // hold, double tap and long press from button2
+  FLAG_MACRO = 0x20,          // press starts macro number button2
+};
+
+enum DebounceFlags : uint8_t {
+  DEBOUNCE_EAGER = 0x01, // a press is reported on its first sample
+};
+
+/**
+ * How the inputs of one class are debounced. The windows are separate for
+ * presses and releases since most switches bounce more on one side, 0 takes
+ * the global debounce time set with the console. An eager input reports a
+ * press on its first edge, its press window is then the lockout after every
+ * change during which the contact may bounce freely. Windows and lockouts
+ * are cut to DEBOUNCE_MAX_SAMPLES scans, 15 ms at the default scan rate,
+ * and the console says when.
+ */
+struct __attribute__((packed)) DebounceProfile {
+  uint8_t pressMs;
+  uint8_t releaseMs;
+  uint8_t flags;
+};
+
+struct __attribute__((packed)) LayoutEntry {
+  uint8_t kind;
+  uint8_t flags;
+  uint8_t pin;
+  uint8_t pin2;
+  uint8_t button;   // pressed, or encoder right
+  uint8_t button2;  // encoder left, first gesture button or macro number
+  uint8_t debounce; // index into the debounce profiles of the header
+};
+
+struct __attribute__((packed)) LayoutHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t count;
+  uint16_t pulseMs; // how long an encoder detent holds its button
+  DebounceProfile debounce[LAYOUT_PROFILES];
+  uint32_t crc; // CRC-32 of the fields above plus the used entries
+};
+
+struct __attribute__((packed)) LayoutBlob {
+  LayoutHeader header;
+  LayoutEntry entries[LAYOUT_MAX_ENTRIES];
+};
+
+/**
+ * A validated blob plus the masks derived from it, so the scan loop never
+ * has to walk the entries to find out what a bit means.
+ */
+struct LayoutTable {
+  LayoutBlob blob;
+  uint64_t inputMask[INPUT_WORDS];  // bits fed by a switch or matrix key
+  uint64_t activeHigh[INPUT_WORDS]; // bits with FLAG_INVERT
+  uint64_t gestureMask[INPUT_WORDS]; // inputs with FLAG_GESTURES
+  uint64_t macroMask[INPUT_WORDS];   // inputs with FLAG_MACRO
+  uint64_t profileMask[LAYOUT_PROFILES][INPUT_WORDS]; // inputs per profile
+  uint64_t eagerMask[INPUT_WORDS]; // inputs with a DEBOUNCE_EAGER profile
+  uint64_t selectorMask[INPUT_WORDS]; // selectors, never layered
+  uint8_t selector[LAYER_MAX_SELECTORS]; // slots with FLAG_LAYER_SELECT
+  uint8_t selectors;
+  uint8_t centre[LAYOUT_MAX_CENTRES]; // slots of KIND_CENTRE entries
+  uint8_t centres;
+  uint8_t fast[LAYOUT_MAX_ENTRIES]; // per encoder slot its KIND_FAST slot
+};
+
+uint32_t layoutCrc(const LayoutBlob &blob);
+size_t layoutSize(const LayoutBlob &blob);
+
+/**
+ * Double buffered layout. A new map is written into staging(), validated by
+ * stage() and only becomes active when the scan loop calls commit() between
+ * two scan cycles, so a scan never sees half of an old and half of a new map.
+ */
+class Layout {
+public:
+  const LayoutTable &active() const { return tables[current]; }
+  const LayoutEntry &entry(uint8_t slot) const {
+    return tables[current].blob.entries[slot];
+  }
+  uint8_t count() const { return tables[current].blob.header.count; }
+  // the KIND_FAST entry of an encoder, LAYOUT_NO_PIN without one
+  uint8_t fastSlot(uint8_t slot) const { return tables[current].fast[slot]; }
+  uint16_t pulseMs() const { return tables[current].blob.header.pulseMs; }
+  uint8_t generation() const { return gen; }
+
+  LayoutBlob &staging() { return tables[current ^ 1].blob; }
+  void clearStaging();
+  uint8_t add(const LayoutEntry &e);
+  void seal(uint16_t pulseMs);
+
+  bool stage();
+  bool pending() const { return isPending; }
+  bool commit();
+
+  // says whether a FLAG_MACRO entry may start macro n, stage() rejects every
+  // such entry while it is not set
+  bool (*macroCheck)(uint8_t macro) = nullptr;
+
+private:
+  LayoutTable tables[2];
+  uint8_t current = 0;
+  uint8_t gen = 0;
+  volatile bool isPending = false;
+};
+
+extern Layout layout;
+
+#endif // LAYOUT_H
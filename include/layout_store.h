@@ -0,0 +1,41 @@
+#ifndef LAYOUT_STORE_H
+#define LAYOUT_STORE_H
+
+#include <stdint.h>
+
+#include "layout.h"
+
+#ifndef LAYOUT_EEPROM_ADDRESS
+#define LAYOUT_EEPROM_ADDRESS 0
+#endif
+
+// a layout frame on serial is this byte followed by the blob
+#define LAYOUT_FRAME_START 0x02
+#define LAYOUT_FRAME_TIMEOUT_MS 100
+
+bool loadStoredLayout();
+void storeLayout(const LayoutBlob &blob);
+void pollLayoutStore();
+
+LayoutBlob &beginLayoutEdit();
+bool finishLayoutEdit();
+
+/**
+ * Reassembles a layout blob arriving byte by byte. Once complete and valid it
+ * is staged for the scan loop and queued for EEPROM.
+ */
+class LayoutReceiver {
+public:
+  enum Result : uint8_t { MORE, DONE, FAILED };
+
+  bool receiving() const { return active; }
+  Result feed(uint8_t b, uint32_t nowMs);
+
+private:
+  LayoutBlob blob;
+  bool active = false;
+  uint16_t length = 0;
+  uint32_t lastByteMs = 0;
+};
+
+#endif // LAYOUT_STORE_H
@@ -0,0 +1,103 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pipeline.h"
+
+/**
+ * Wire format of the box to box link: a secondary box streams the packed
+ * image of its buttons to the primary one over a UART. Every frame is
+ *
+ *   0xA5 | seq | type | length | payload[length] | crc16 (lo, hi)
+ *
+ * with a CRC-16/CCITT over seq to the end of the payload. A full frame
+ * carries the state words, a delta frame the slots that flipped since the
+ * frame before it. A delta only applies on top of the frame with the
+ * previous sequence number, after a gap the receiver waits for the next full
+ * frame, which goes out at least every LINK_KEYFRAME_MS. This header is
+ * shared with the host tools, keep it free of Arduino dependencies.
+ */
+
+#define LINK_SYNC 0xA5
+#define LINK_HEADER_BYTES 4
+#define LINK_CRC_BYTES 2
+
+// slots carried over the link, the first LINK_WORDS words of the state
+#define LINK_WORDS 1
+#define LINK_SLOTS (LINK_WORDS * 64)
+
+// more flips than this in one frame and a full frame is cheaper
+#define LINK_MAX_DELTA 6
+
+#define LINK_MAX_PAYLOAD (LINK_WORDS * 8)
+#define LINK_MAX_FRAME (LINK_HEADER_BYTES + LINK_MAX_PAYLOAD + LINK_CRC_BYTES)
+
+#ifndef LINK_KEYFRAME_MS
+#define LINK_KEYFRAME_MS 20
+#endif
+
+enum LinkFrameType : uint8_t {
+  LINK_FULL = 1,
+  LINK_DELTA = 2,
+};
+
+uint16_t linkCrc(const uint8_t *data, size_t length);
+
+/**
+ * Sending end. Keeps the state of the last frame so it only has to send
+ * what changed.
+ */
+class LinkEncoder {
+public:
+  /**
+   * Writes the frame for state into out (LINK_MAX_FRAME bytes) and returns
+   * its length, 0 when nothing changed and no full frame was asked for.
+   */
+  uint8_t encode(const uint64_t *state, uint8_t *out, bool full);
+
+  uint32_t frames = 0;
+  uint32_t fullFrames = 0;
+
+private:
+  uint64_t sent[LINK_WORDS] = {};
+  uint8_t seq = 0;
+  bool started = false;
+};
+
+/**
+ * Receiving end, fed one byte at a time straight from the UART. Bytes that
+ * do not form a valid frame are skipped until the next sync byte.
+ */
+class LinkDecoder {
+public:
+  // returns true when the byte completed a frame that changed the state
+  bool feed(uint8_t byte);
+  const uint64_t *state() const { return current; }
+  bool synced() const { return inSync; }
+  void reset();
+
+  uint32_t frames = 0;
+  uint32_t crcErrors = 0;
+  uint32_t gaps = 0; // lost frames, counted per delta that could not apply
+  uint32_t junk = 0; // bytes skipped while hunting for a sync byte
+
+private:
+  bool apply();
+
+  uint8_t frame[LINK_MAX_FRAME];
+  uint8_t length = 0;
+  uint8_t lastSeq = 0;
+  bool inSync = false;
+  uint64_t current[LINK_WORDS] = {};
+};
+
+/**
+ * Turns the difference between two remote states into button changes, bit
+ * n of the remote image is button first + n here.
+ */
+void linkMerge(const uint64_t *before, const uint64_t *after, uint8_t first,
+               ButtonSink &sink);
+
+#endif // LINK_H
@@ -0,0 +1,114 @@
+#ifndef LINK_PORT_H
+#define LINK_PORT_H
+
+#include <Arduino.h>
+
+#include "layers.h"
+#include "link.h"
+#include "stats.h"
+
+/**
+ * Box to box link over a hardware UART, see link.h for the wire format. A
+ * box built with -D BUTTONBOX_LINK_SLAVE streams the buttons it has down,
+ * as its own report has them after the layout, layers, pulse trains,
+ * gestures and macros; one built with -D BUTTONBOX_LINK_MASTER merges them
+ * into its own report with button n of the slave as button
+ * LINK_FIRST_BUTTON + n - 1, so the sim sees a single joystick. Slave
+ * buttons above LINK_SLOTS do not travel. Connect TX of the slave to RX of
+ * the master and the grounds.
+ */
+
+#if defined(BUTTONBOX_LINK_MASTER) && defined(BUTTONBOX_LINK_SLAVE)
+#error "a box is either link master or link slave"
+#endif
+
+#if defined(BUTTONBOX_LINK_MASTER)
+#define LINK_MODE 2
+#elif defined(BUTTONBOX_LINK_SLAVE)
+#define LINK_MODE 1
+#else
+#define LINK_MODE 0
+#endif
+
+#if LINK_MODE == 2 && (!defined(BUTTONBOX_EXTREME_JOYSTICK) || LAYER_COUNT > 1)
+// the remote buttons take the upper 64 ids, where a layer or the encoder
+// section of the report ids layout would be
+#error "a link master needs BUTTONBOX_EXTREME_JOYSTICK without layers"
+#endif
+
+#ifndef LINK_SERIAL
+#define LINK_SERIAL Serial2
+#endif
+
+// 10 bits per byte, a delta frame with one flip takes 35 us on the wire
+#ifndef LINK_BAUD
+#define LINK_BAUD 2000000
+#endif
+
+#ifndef LINK_FIRST_BUTTON
+#define LINK_FIRST_BUTTON 65
+#endif
+
+// the master lets go of every remote button when the slave goes quiet
+#ifndef LINK_TIMEOUT_MS
+#define LINK_TIMEOUT_MS (5 * LINK_KEYFRAME_MS)
+#endif
+
+static_assert(LINK_FIRST_BUTTON + LINK_SLOTS - 1 <= 128,
+              "remote buttons must fit the report");
+
+/**
+ * Polled from loop(). The slave sends a frame whenever its buttons changed,
+ * and a full frame every LINK_KEYFRAME_MS; the master drains the UART,
+ * merges every frame that changed something and sends the report right
+ * away. Without a link mode everything here compiles to nothing.
+ */
+class LinkPort {
+public:
+#if LINK_MODE > 0
+  void begin();
+  void poll();
+#else
+  void begin() {}
+  void poll() {}
+#endif
+
+#if LINK_MODE == 1
+  // every change the joystick sink makes, bit n is button n + 1
+  void button(uint8_t id, bool pressed) {
+    uint8_t n = id - 1;
+    if (id == 0 || n >= LINK_SLOTS) {
+      return;
+    }
+    uint64_t bit = 1ULL << (n & 63);
+    image[n >> 6] = pressed ? image[n >> 6] | bit : image[n >> 6] & ~bit;
+  }
+#else
+  void button(uint8_t, bool) {}
+#endif
+
+#if LINK_MODE == 2
+  const LinkDecoder &decoder() const { return rx; }
+  uint32_t timeouts = 0;
+  Histogram frameUs; // from the first byte read to the report, in us
+
+private:
+  LinkDecoder rx;
+  uint64_t merged[LINK_WORDS] = {};
+  uint32_t lastFrameMs = 0;
+  uint8_t buffer[256];
+#elif LINK_MODE == 1
+  const LinkEncoder &encoder() const { return tx; }
+  uint32_t stalls = 0; // polls that found the transmit buffer full
+
+private:
+  LinkEncoder tx;
+  uint64_t image[LINK_WORDS] = {};
+  uint32_t lastFullMs = 0;
+  uint8_t buffer[4 * LINK_MAX_FRAME];
+#endif
+};
+
+extern LinkPort linkPort;
+
+#endif // LINK_PORT_H
@@ -0,0 +1,86 @@
+#ifndef MACROS_H
+#define MACROS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pipeline.h"
+#include "stats.h"
+
+#ifdef __IMXRT1062__
+#include <avr/pgmspace.h>
+#else
+// host builds of the tools, the tables are plain data there
+#define PROGMEM
+#define memcpy_P memcpy
+#endif
+
+/**
+ * Macros: an input flagged FLAG_MACRO starts macro number button2 when it
+ * goes down. A macro is a constant table of steps; each step presses or
+ * releases one button and then waits before the next one. Waits run on the
+ * deferred timer wheel, so a macro never holds up the scan loop and several
+ * can run at once, one per runner.
+ *
+ * The step tables and the macro table must be PROGMEM: the Teensy 4 copies
+ * plain const data from flash into DTCM at boot. The sequencer only reads
+ * them with memcpy_P, one step at a time.
+ */
+
+#ifndef MACRO_MAX_RUNNING
+#define MACRO_MAX_RUNNING 4
+#endif
+
+struct MacroStep {
+  uint8_t button;
+  uint8_t pressed;
+  uint16_t waitMs; // before the next step
+};
+
+struct Macro {
+  const MacroStep *steps;
+  uint8_t length;
+};
+
+#define MACRO(steps) {steps, sizeof(steps) / sizeof(steps[0])}
+
+typedef uint32_t (*MacroClock)();
+
+class MacroSequencer {
+public:
+  void define(const Macro *table, uint8_t count);
+  void begin(ButtonSink &sink, MacroClock clock);
+  bool start(uint8_t macro);
+  void end();
+
+  uint8_t running() const;
+  uint8_t count() const { return macroCount; }
+  bool valid(uint8_t macro) const;
+
+  uint32_t started = 0;
+  uint32_t dropped = 0; // started while every runner was busy
+  Histogram error;      // us between the planned and the actual step time
+
+private:
+  struct Runner {
+    const MacroStep *first;
+    const MacroStep *next;
+    uint8_t left;
+    uint8_t generation;
+    uint32_t dueUs;
+  };
+
+  static void onStep(uint16_t arg);
+  void run(uint8_t r);
+  void stop(uint8_t r);
+
+  Runner runners[MACRO_MAX_RUNNING] = {};
+  const Macro *table = nullptr;
+  uint8_t macroCount = 0;
+  ButtonSink *sink = nullptr;
+  MacroClock clock = nullptr;
+};
+
+extern MacroSequencer macros;
+
+#endif // MACROS_H
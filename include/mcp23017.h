@@ -0,0 +1,90 @@
+#ifndef MCP23017_H
+#define MCP23017_H
+
+#include <stdint.h>
+
+#include "stats.h"
+
+/**
+ * MCP23017 I/O expanders, read in bursts whenever their shared INT line
+ * fires. With IOCON.BANK = 0 and SEQOP = 1 the register pointer toggles
+ * between GPIOA and GPIOB, so once it points at GPIOA every two byte read
+ * returns both ports without addressing a register first: a burst is one
+ * START, two bytes and a STOP per chip.
+ *
+ * Build with -D BUTTONBOX_MCP23017=<n> for n chips at addresses 0x20 + 0..n-1.
+ */
+
+#ifdef BUTTONBOX_MCP23017
+#define MCP23017_CHIPS BUTTONBOX_MCP23017
+#else
+#define MCP23017_CHIPS 0
+#endif
+
+#define MCP23017_MAX_CHIPS 8
+#define MCP23017_ADDRESS 0x20
+
+static_assert(MCP23017_CHIPS <= MCP23017_MAX_CHIPS,
+              "three address pins allow eight chips on one bus");
+
+// registers with IOCON.BANK = 0, the B register follows its A register
+#define MCP23017_IODIRA 0x00
+#define MCP23017_GPINTENA 0x04
+#define MCP23017_INTCONA 0x08
+#define MCP23017_IOCON 0x0A
+#define MCP23017_GPPUA 0x0C
+#define MCP23017_GPIOA 0x12
+
+#define MCP23017_IOCON_MIRROR 0x40 // INTA and INTB are one line
+#define MCP23017_IOCON_SEQOP 0x20  // no auto increment, pointer toggles A/B
+#define MCP23017_IOCON_ODR 0x04    // INT is open drain, chips share a pull-up
+
+/**
+ * Non-blocking I2C master. startRead() queues the whole transfer and returns
+ * at once, poll() reports how far it got. On the device this sits on the
+ * LPI2C command FIFO, on the host it can be anything that plays the bus.
+ */
+class I2cBus {
+public:
+  enum Status : uint8_t { BUSY, DONE, FAILED };
+
+  virtual void startRead(uint8_t address, uint8_t length) = 0;
+  virtual Status poll(uint8_t *data, uint8_t length) = 0;
+};
+
+/**
+ * Reads all chips one after the other and keeps the last port words. The
+ * INT handler calls interrupt() to start a burst, the scan calls poll() to
+ * move it along, so nothing ever waits for the bus.
+ */
+class ExpanderChain {
+public:
+  explicit ExpanderChain(I2cBus &bus) : bus(bus) {}
+
+  void begin(uint8_t chips);
+  uint8_t chips() const { return count; }
+  bool idle() const { return !busy; }
+  uint16_t word(uint8_t chip) const { return words[chip]; }
+
+  void interrupt(uint32_t cycles);
+  bool poll(uint32_t cycles);
+  void recheck(uint32_t cycles, bool asserted);
+  void reported(uint32_t cycles);
+
+  uint32_t reads = 0;
+  uint32_t errors = 0;
+  Histogram edgeToData;   // INT edge until both ports of every chip are in
+  Histogram edgeToReport; // first unreported edge until the report went out
+
+private:
+  I2cBus &bus;
+  uint16_t words[MCP23017_MAX_CHIPS];
+  uint8_t count = 0;
+  uint8_t current = 0;
+  volatile bool busy = false;
+  bool unreported = false;
+  uint32_t edge = 0;
+  uint32_t firstEdge = 0;
+};
+
+#endif // MCP23017_H
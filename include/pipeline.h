@@ -0,0 +1,87 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+
+#include "debounce.h"
+#include "layers.h"
+#include "layout.h"
+
+/**
+ * Receives the button changes produced by the pipeline. flush() marks the end
+ * of a scan cycle so all changes of one cycle can go out as a single report.
+ */
+class ButtonSink {
+public:
+  virtual void button(uint8_t id, bool pressed) = 0;
+  virtual void flush() = 0;
+};
+
+/**
+ * Sees the debounced flips and stable levels of every word in a scan that
+ * changed anything, once the debouncers decided and before any change
+ * reaches the sink.
+ */
+typedef void (*AcceptHook)(const uint64_t *flipped, const uint64_t *stable);
+
+class ChordMatcher;
+class InputCounters;
+class GestureEngine;
+class MacroSequencer;
+
+/**
+ * Hardware independent part of the scan loop: raw packed samples go in,
+ * debounced button changes mapped through the active layout come out.
+ */
+class InputPipeline {
+public:
+  InputPipeline(Layout &layout, ButtonSink &sink)
+      : layout(layout), sink(sink) {}
+
+  void begin(const uint64_t *raw);
+  void end();
+  bool scan(const uint64_t *raw);
+  // the global debounce time, used where a profile leaves a window at 0
+  void setDebounce(uint16_t ms, uint32_t scanUs);
+  uint8_t debounceSamples() const { return samples; }
+  // the longest window or eager lockout the debouncers hold at this scan
+  // rate, longer ones are cut to it and the console says so
+  uint16_t maxDebounceMs() const {
+    return DEBOUNCE_MAX_SAMPLES * scanUs / 1000;
+  }
+  uint64_t stable(uint8_t word) const { return debounce[word].stable; }
+
+  uint8_t activeLayer() const { return layer; }
+  uint8_t map(uint8_t button) const { return LAYER_MAP.map[layer][button]; }
+
+  // inputs with FLAG_GESTURES are passed on to this, see gestures.h
+  void setGestures(GestureEngine *g) { gestures = g; }
+  // chord members are filtered through this, see chords.h
+  void setChords(ChordMatcher *c) { chords = c; }
+  // inputs with FLAG_MACRO start macros on this, see macros.h
+  void setMacros(MacroSequencer *m) { macros = m; }
+  // every sample and flip is counted here, see input_counters.h
+  void setCounters(InputCounters *c) { counters = c; }
+  // every debounced change is passed on here first, see AcceptHook
+  void setAcceptHook(AcceptHook h) { acceptHook = h; }
+
+private:
+  uint8_t selectedLayer() const;
+  uint8_t toSamples(uint16_t ms) const;
+  void applyProfiles(const LayoutTable &t);
+  void press(uint8_t word, uint64_t bits, bool pressed);
+
+  Layout &layout;
+  ButtonSink &sink;
+  GestureEngine *gestures = nullptr;
+  ChordMatcher *chords = nullptr;
+  MacroSequencer *macros = nullptr;
+  InputCounters *counters = nullptr;
+  AcceptHook acceptHook = nullptr;
+  PackedDebouncer debounce[INPUT_WORDS];
+  uint32_t scanUs = 1000;
+  uint8_t samples = 5;
+  uint8_t layer = 0;
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,89 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+#include "stats.h"
+
+/**
+ * Cycle counts of every job loop() runs and of the scan task, plus a
+ * histogram of the loop period, to see where the time goes and how much a
+ * loop iteration wanders.
+ *
+ * Build with -D BUTTONBOX_PROFILE to enable it. Without it run() only calls
+ * the job and the rest compiles to nothing, so release builds pay nothing.
+ */
+
+#ifdef BUTTONBOX_PROFILE
+#define PROFILE_ENABLED 1
+#else
+#define PROFILE_ENABLED 0
+#endif
+
+enum ProfileTask : uint8_t {
+  TASK_SCAN, // the scan tick scheduled on taskManager
+  TASK_ENCODERS,
+  TASK_DEFERRED,
+  TASK_ANALOG,
+  TASK_CONSOLE,
+  TASK_TELEMETRY,
+  TASK_USB,
+  TASK_LINK,
+  TASK_STORE,
+  TASK_COUNT
+};
+
+struct TaskProfile {
+  uint32_t calls;
+  uint32_t min; // cycles of one call
+  uint32_t max;
+  uint64_t total;
+};
+
+class Profiler {
+public:
+#if PROFILE_ENABLED
+  Profiler() { clear(); }
+
+  template <typename F> void run(ProfileTask task, F job) {
+    uint32_t start = ARM_DWT_CYCCNT;
+    job();
+    add(task, ARM_DWT_CYCCNT - start);
+  }
+
+  // called first thing in loop(), times one iteration to the next
+  void loop() {
+    uint32_t now = ARM_DWT_CYCCNT;
+    if (lastLoop) {
+      loopPeriod.add(now - lastLoop);
+    }
+    lastLoop = now;
+  }
+
+  void clear();
+  const TaskProfile &task(uint8_t task) const { return tasks[task]; }
+  static const char *name(uint8_t task);
+
+  Histogram loopPeriod; // cycles between two loop() calls
+
+private:
+  void add(ProfileTask task, uint32_t cycles) {
+    TaskProfile &t = tasks[task];
+    t.calls++;
+    t.total += cycles;
+    t.min = cycles < t.min ? cycles : t.min;
+    t.max = cycles > t.max ? cycles : t.max;
+  }
+
+  TaskProfile tasks[TASK_COUNT];
+  uint32_t lastLoop;
+#else
+  template <typename F> void run(ProfileTask, F job) { job(); }
+  void loop() {}
+  void clear() {}
+#endif
+};
+
+extern Profiler profiler;
+
+#endif // PROFILER_H
@@ -0,0 +1,63 @@
+#ifndef PULSE_TRAIN_H
+#define PULSE_TRAIN_H
+
+#include <stdint.h>
+
+#include "pipeline.h"
+
+#ifndef MAX_ROTARY_ENCODERS
+#define MAX_ROTARY_ENCODERS 8
+#endif
+
+static_assert(MAX_ROTARY_ENCODERS <= 8, "one pin change handler per encoder");
+
+// pulses a train keeps waiting per kind, a pulse and its gap take two pulse
+// widths so more would only play on after the knob stopped
+#ifndef ENCODER_MAX_QUEUED
+#define ENCODER_MAX_QUEUED 4
+#endif
+
+/**
+ * Plays the logical steps of the encoders as trains of button pulses on the
+ * deferred timer wheel, one pulse at a time per encoder. A step presses the
+ * button of its direction for the pulse width of the layout, and the next
+ * one waits as long again so the host sees every release. The buttons come
+ * from the layout entry a train is attached to, through the active layer.
+ *
+ * That caps a train at one step per two pulse widths, 25 a second at 20 ms,
+ * and steps beyond the short queue are dropped. An encoder with a KIND_FAST
+ * entry therefore plays a detent that acceleration multiplies as a single
+ * pulse of its fast buttons, which the host binds to a bigger step, and fast
+ * pulses go before the plain ones.
+ */
+class PulseTrains {
+public:
+  void begin(ButtonSink &sink, const InputPipeline &pipeline) {
+    this->sink = &sink;
+    this->pipeline = &pipeline;
+  }
+  void attach(uint8_t n, uint8_t slot);
+  void step(uint8_t n, int16_t steps, int16_t fast = 0);
+
+private:
+  enum Phase : uint8_t { IDLE, PRESSED, GAP };
+
+  struct Train {
+    uint8_t slot;   // layout entry with the buttons
+    int16_t queued; // signed pulses still to play
+    int16_t fast;   // the same on the fast buttons
+    Phase phase;
+    uint8_t button; // held while PRESSED
+  };
+
+  static void startPulse(uint16_t n);
+  static void endPulse(uint16_t n);
+
+  Train trains[MAX_ROTARY_ENCODERS] = {};
+  ButtonSink *sink = nullptr;
+  const InputPipeline *pipeline = nullptr;
+};
+
+extern PulseTrains pulseTrains;
+
+#endif // PULSE_TRAIN_H
@@ -0,0 +1,124 @@
+#ifndef QUADRATURE_H
+#define QUADRATURE_H
+
+#include <stdint.h>
+
+/**
+ * Quadrature decoding and acceleration for the rotary encoders, kept free
+ * of Arduino so it runs the same on the host.
+ */
+
+// rest state of a detented encoder, both contacts open and pulled up
+#define QUAD_REST 0x03
+
+// steps per detent by time since the previous detent, bin k holds the
+// intervals in [2^(k-1), 2^k) units of 1024 us (bin 0: shorter than one
+// unit); intervals past the table step once
+#ifndef ENCODER_ACCEL_CURVE
+#define ENCODER_ACCEL_CURVE {8, 8, 8, 6, 4, 3, 2, 1}
+#endif
+
+constexpr uint8_t ENCODER_ACCEL[] = ENCODER_ACCEL_CURVE;
+#define ENCODER_ACCEL_BINS (sizeof(ENCODER_ACCEL) / sizeof(ENCODER_ACCEL[0]))
+
+/**
+ * Direction of one transition from the previous to the current levels (A in
+ * bit 0, B in bit 1), indexed by (previous << 2) | current. A leading B is
+ * +1. Impossible double steps count 0.
+ */
+constexpr int8_t QUAD_TABLE[16] = {0, 1,  -1, 0, -1, 0, 0,  1,
+                                   1, 0, 0,  -1, 0, -1, 1, 0};
+
+struct QuadratureDecoder {
+  uint8_t ab = QUAD_REST;
+  int8_t sub = 0; // transitions since the last detent
+
+  /**
+   * Takes the current AB levels, returns +1 or -1 for a detent and 0
+   * otherwise. In quad precision every transition is a detent. Otherwise a
+   * detent is counted when the encoder is back at rest after at least half
+   * a cycle in one direction, which tolerates one lost transition.
+   */
+  int8_t update(uint8_t levels, bool quadPrecision) {
+    int8_t d = QUAD_TABLE[(ab << 2) | levels];
+    ab = levels;
+    if (quadPrecision) {
+      return d;
+    }
+    sub += d;
+    if (levels != QUAD_REST) {
+      return 0;
+    }
+    int8_t detent = sub >= 2 ? 1 : sub <= -2 ? -1 : 0;
+    sub = 0;
+    return detent;
+  }
+};
+
+// a detent against the previous direction within this window is a blip
+#ifndef ENCODER_REVERSAL_US
+#define ENCODER_REVERSAL_US 10000
+#endif
+
+// a detent whose last transition came sooner than this after the one
+// before it is noise, no hand turns that fast
+#ifndef ENCODER_MIN_DWELL_US
+#define ENCODER_MIN_DWELL_US 100
+#endif
+
+/**
+ * Rejection stage between the decoder and the rest of the encoder path.
+ * Cheap encoders produce the odd detent in the wrong direction while being
+ * turned, and noise can run through a whole quadrature cycle in a few
+ * microseconds; both cost a pulse and a report if they get through.
+ */
+struct DetentFilter {
+  uint32_t reversalUs = ENCODER_REVERSAL_US;
+  uint32_t dwellUs = ENCODER_MIN_DWELL_US;
+  uint32_t lastTransitionUs = 0;
+  uint32_t lastInterval = UINT32_MAX;
+  uint32_t lastDetentUs = 0;
+  int8_t lastDir = 0;
+  uint32_t reversals = 0; // rejected as reversal blips
+  uint32_t bounces = 0;   // rejected for too short a dwell
+
+  // call on every transition, returns the time since the previous one
+  uint32_t transition(uint32_t now) {
+    lastInterval = now - lastTransitionUs;
+    lastTransitionUs = now;
+    return lastInterval;
+  }
+
+  // call on every detent, returns true when it may pass
+  bool accept(int8_t dir, uint32_t now) {
+    if (lastInterval < dwellUs) {
+      bounces++;
+      return false;
+    }
+    if (lastDir && dir != lastDir && now - lastDetentUs < reversalUs) {
+      reversals++;
+      return false;
+    }
+    return true;
+  }
+
+  // records an accepted detent, returns the time since the previous one
+  uint32_t detent(int8_t dir, uint32_t now) {
+    uint32_t interval = now - lastDetentUs;
+    lastDetentUs = now;
+    lastDir = dir;
+    return interval;
+  }
+};
+
+/**
+ * Logical steps for a detent that came intervalUs after the previous one.
+ * A clz and a table load, whatever the speed.
+ */
+inline uint8_t accelSteps(uint32_t intervalUs) {
+  uint32_t ms = intervalUs >> 10;
+  uint8_t bin = ms ? 32 - __builtin_clz(ms) : 0;
+  return bin < ENCODER_ACCEL_BINS ? ENCODER_ACCEL[bin] : 1;
+}
+
+#endif // QUADRATURE_H
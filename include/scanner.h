@@ -0,0 +1,123 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <Arduino.h>
+#include <TaskManagerIO.h>
+
+#include "debounce_profiles.h"
+#include "expander_port.h"
+#include "gather.h"
+#include "layout.h"
+#include "link_port.h"
+#include "pipeline.h"
+#include "shift_chain.h"
+#include "stats.h"
+#include "telemetry_port.h"
+
+#ifndef SCAN_INTERVAL_US
+#define SCAN_INTERVAL_US 1000
+#endif
+
+#define SCAN_MAX_PORTS 4
+// expander chip n is gathered from port word SCAN_MAX_PORTS + n
+#define SCAN_MAX_WORDS (SCAN_MAX_PORTS + MCP23017_MAX_CHIPS)
+#define SCAN_MAX_ROWS 8
+
+/**
+ * Sends button changes to the USB joystick, one report per scan cycle.
+ */
+class JoystickSink : public ButtonSink {
+  bool dirty = true;
+
+public:
+  void button(uint8_t id, bool pressed) override {
+    Joystick.button(id, pressed);
+    linkPort.button(id, pressed);
+    scanStats.events++;
+    telemetryPort.trace(TRACE_BUTTON, id, pressed);
+    dirty = true;
+  }
+  void axis(uint8_t axis, uint16_t value) {
+#if JOYSTICK_SIZE == 16 || JOYSTICK_SIZE == 64
+    switch (axis) {
+    case 0: Joystick.X(value); break;
+    case 1: Joystick.Y(value); break;
+    case 2: Joystick.Z(value); break;
+    case 3: Joystick.Zrotate(value); break;
+    }
+    dirty = true;
+#endif
+  }
+  void flush() override {
+    if (dirty) {
+      Joystick.send_now();
+      scanStats.reports++;
+      telemetryPort.trace(TRACE_REPORT, 0, scanStats.reports);
+      dirty = false;
+    }
+  }
+};
+
+/**
+ * Samples every switch and matrix key described by the active layout at a
+ * fixed rate and feeds them through the input pipeline. The matrix is driven
+ * one row per scan, so a row has a whole scan interval to settle before its
+ * columns are read and no scan ever busy waits.
+ */
+class Scanner {
+public:
+  void begin();
+  void tick();
+
+  void setScanMicros(uint32_t us);
+  uint32_t scanMicros() const { return scanUs; }
+  void setDebounceMillis(uint16_t ms);
+  uint16_t debounceMillis() const { return debounceMs; }
+
+  // pins an input backend uses as its bus, a layout cannot take them over
+  static bool busPin(uint8_t pin) {
+    return expanderPort.ownsPin(pin) || shiftChain.ownsPin(pin);
+  }
+
+private:
+  struct MatrixRow {
+    uint8_t pin;
+    uint8_t first;
+    uint8_t count;
+    uint64_t mask[INPUT_WORDS];
+  };
+
+  void configure();
+  uint8_t portOf(uint8_t pin);
+  void addGather(uint8_t pin, uint8_t slot);
+  void sample();
+  void driveRow(uint8_t row, bool active);
+  void swapLayout();
+  void traceEdges(uint32_t cycles);
+  void traceAccepts(const uint64_t *flipped, const uint64_t *stable);
+
+  volatile uint32_t *ports[SCAN_MAX_PORTS];
+  uint8_t portCount = 0;
+  GatherEntry table[LAYOUT_MAX_ENTRIES];
+  uint8_t tableCount = 0;
+  uint8_t directCount = 0;
+  uint64_t directMask[INPUT_WORDS];
+  uint64_t expanderMask[INPUT_WORDS];
+  uint64_t shiftMask[SHIFT_WORDS + 1]; // + 1 keeps it legal without a chain
+  MatrixRow rows[SCAN_MAX_ROWS];
+  uint8_t rowCount = 0;
+  uint8_t activeRow = 0;
+  uint64_t level[INPUT_WORDS];
+  uint64_t traced[INPUT_WORDS]; // level of the last scan, for edge traces
+  uint32_t sampled = 0;         // cycle count of the last sample, for traces
+
+  uint32_t scanUs = SCAN_INTERVAL_US;
+  uint16_t debounceMs = DEBOUNCE_MS;
+  taskid_t task = TASKMGR_INVALIDID;
+};
+
+extern JoystickSink joystickSink;
+extern InputPipeline pipeline;
+extern Scanner scanner;
+
+#endif // SCANNER_H
@@ -0,0 +1,69 @@
+#ifndef SHIFT_CHAIN_H
+#define SHIFT_CHAIN_H
+
+#include <Arduino.h>
+
+#include "shift_sampler.h"
+
+#ifndef SHIFT_SAMPLE_US
+#define SHIFT_SAMPLE_US 250
+#endif
+
+// SPI is LPSPI4 (MOSI 11, MISO 12, SCK 13) and SPI1 LPSPI3 (26, 1, 27);
+// set the pins along with the bus
+#ifndef SHIFT_SPI
+#define SHIFT_SPI SPI
+#define SHIFT_MOSI_PIN 11
+#define SHIFT_MISO_PIN 12
+#define SHIFT_SCK_PIN 13
+#endif
+
+#ifndef SHIFT_SPI_HZ
+#define SHIFT_SPI_HZ 8000000
+#endif
+
+// PL of every chip, low latches the inputs
+#ifndef SHIFT_LOAD_PIN
+#define SHIFT_LOAD_PIN 10
+#endif
+
+#if SHIFT_CHIPS > 0
+#include <EventResponder.h>
+#endif
+
+/**
+ * Owns the SPI bus: an IntervalTimer latches the chain and starts a DMA
+ * transfer into the free buffer of the sampler, the DMA completion flips
+ * them. The CPU never touches a bit. Without BUTTONBOX_SHIFT_CHIPS
+ * everything here compiles to nothing.
+ */
+class ShiftChain {
+public:
+#if SHIFT_CHIPS > 0
+  void begin();
+  void merge(uint64_t *level, const uint64_t *mask) const {
+    sampler.merge(level, mask);
+  }
+  const ShiftSampler &stats() const { return sampler; }
+  // the bus and PL, a layout entry on one of them is left alone
+  bool ownsPin(uint8_t pin) const {
+    return pin == SHIFT_MOSI_PIN || pin == SHIFT_MISO_PIN ||
+           pin == SHIFT_SCK_PIN || pin == SHIFT_LOAD_PIN;
+  }
+
+private:
+  static void onTimer();
+  static void onDone(EventResponder &event);
+
+  ShiftSampler sampler;
+  EventResponder done;
+  IntervalTimer timer;
+#else
+  void begin() {}
+  bool ownsPin(uint8_t pin) const { return false; }
+#endif
+};
+
+extern ShiftChain shiftChain;
+
+#endif // SHIFT_CHAIN_H
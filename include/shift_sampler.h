@@ -0,0 +1,97 @@
+#ifndef SHIFT_SAMPLER_H
+#define SHIFT_SAMPLER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "layout.h"
+
+/**
+ * A daisy chain of 74HC165 shift registers clocked in by SPI at a fixed
+ * rate. Byte j of a transfer is chip j counted from the Teensy, bit i of it
+ * is input Di, so on this little endian core the receive buffer already is
+ * the packed input state: chip j input i is slot SHIFT_FIRST_SLOT + 8j + i,
+ * and the scanner merges it in with one masked copy per word.
+ *
+ * Build with -D BUTTONBOX_SHIFT_CHIPS=<n>, and raise LAYOUT_MAX_ENTRIES to
+ * make room for the chain.
+ */
+
+#ifdef BUTTONBOX_SHIFT_CHIPS
+#define SHIFT_CHIPS BUTTONBOX_SHIFT_CHIPS
+#else
+#define SHIFT_CHIPS 0
+#endif
+
+// first slot fed by the chain, word aligned so a word copy needs no shifts
+#ifndef SHIFT_FIRST_SLOT
+#define SHIFT_FIRST_SLOT 64
+#endif
+
+#define SHIFT_FIRST_WORD (SHIFT_FIRST_SLOT / 64)
+#define SHIFT_WORDS ((SHIFT_CHIPS + 7) / 8)
+
+static_assert(SHIFT_FIRST_SLOT % 64 == 0, "the chain must start a new word");
+static_assert(SHIFT_CHIPS == 0 ||
+                  SHIFT_FIRST_SLOT + SHIFT_CHIPS * 8 <= LAYOUT_MAX_ENTRIES,
+              "raise LAYOUT_MAX_ENTRIES to cover the chain");
+
+#if SHIFT_CHIPS > 0
+
+/**
+ * The two receive buffers of the chain. The sample timer asks start() for
+ * the buffer the next transfer fills, the transfer completion calls done()
+ * which makes it the one words() returns, so the scan always reads the last
+ * complete sample and never one that is half written.
+ */
+class ShiftSampler {
+public:
+  void begin() {
+    // pulled up inputs read high until the first sample says otherwise
+    memset(buffers, 0xFF, sizeof(buffers));
+    ready = 0;
+    busy = false;
+  }
+
+  // the buffer to fill, or nullptr while the last transfer still runs
+  uint8_t *start() {
+    if (busy) {
+      overruns++;
+      return nullptr;
+    }
+    busy = true;
+    return (uint8_t *)buffers[ready ^ 1];
+  }
+
+  void done() {
+    ready ^= 1;
+    samples++;
+    busy = false;
+  }
+
+  bool running() const { return busy; }
+
+  // the last complete sample, SHIFT_WORDS words from SHIFT_FIRST_WORD on
+  const uint64_t *words() const { return buffers[ready]; }
+
+  // copies the chain bits in mask into the packed input state
+  void merge(uint64_t *level, const uint64_t *mask) const {
+    const uint64_t *chain = buffers[ready];
+    for (uint8_t w = 0; w < SHIFT_WORDS; w++) {
+      uint64_t &l = level[SHIFT_FIRST_WORD + w];
+      l = (l & ~mask[w]) | (chain[w] & mask[w]);
+    }
+  }
+
+  volatile uint32_t samples = 0;
+  volatile uint32_t overruns = 0; // timer fired while a transfer was running
+
+private:
+  uint64_t buffers[2][SHIFT_WORDS];
+  volatile uint8_t ready = 0;
+  volatile bool busy = false;
+};
+
+#endif
+
+#endif // SHIFT_SAMPLER_H
@@ -0,0 +1,60 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#define HISTOGRAM_BINS 24
+
+/**
+ * Power of two histogram: bin k counts the samples in [2^(k-1), 2^k), bin 0
+ * counts zeroes and the last bin everything that does not fit. Adding a
+ * sample is a count-leading-zeros and an increment.
+ */
+struct Histogram {
+  uint32_t bins[HISTOGRAM_BINS];
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+
+  Histogram() { clear(); }
+
+  void clear() {
+    for (uint8_t i = 0; i < HISTOGRAM_BINS; i++) {
+      bins[i] = 0;
+    }
+    count = 0;
+    min = UINT32_MAX;
+    max = 0;
+  }
+
+  void add(uint32_t v) {
+    uint8_t bin = v ? 32 - __builtin_clz(v) : 0;
+    bins[bin < HISTOGRAM_BINS ? bin : HISTOGRAM_BINS - 1]++;
+    count++;
+    min = v < min ? v : min;
+    max = v > max ? v : max;
+  }
+
+  static uint32_t lowerBound(uint8_t bin) { return bin ? 1UL << (bin - 1) : 0; }
+};
+
+/**
+ * Counters of the scan loop, all in scan or report units.
+ */
+struct ScanStats {
+  uint32_t scans;
+  uint32_t events;
+  uint32_t reports;
+  Histogram scanCycles;
+
+  void clear() {
+    scans = 0;
+    events = 0;
+    reports = 0;
+    scanCycles.clear();
+  }
+};
+
+extern ScanStats scanStats;
+
+#endif // STATS_H
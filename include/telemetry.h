@@ -0,0 +1,127 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+/**
+ * Packets exchanged over the raw HID interface (build with -D
+ * BUTTONBOX_RAWHID). Every packet is exactly one 64 byte HID report, so the
+ * device can hand a ring slot to the USB stack as is. This header is shared
+ * with the host tools, keep it free of Arduino dependencies.
+ */
+
+#define TELEMETRY_PACKET_SIZE 64
+#define TELEMETRY_PAYLOAD_SIZE 60
+#define TELEMETRY_HISTOGRAM_BINS 14
+#define TELEMETRY_TRACE_RECORDS 7
+
+#define TELEMETRY_VENDOR_ID 0x16C0
+#define TELEMETRY_PRODUCT_ID 0x0487
+#define TELEMETRY_USAGE_PAGE 0xFFAB
+
+enum TelemetryType : uint8_t {
+  // device to host
+  TM_COUNTERS = 0x01,
+  TM_HISTOGRAM = 0x02,
+  TM_TRACE = 0x03,
+  TM_ACK = 0x04,
+  // host to device
+  TM_SUBSCRIBE = 0x81,
+  TM_LAYOUT = 0x82,
+};
+
+enum TelemetryStream : uint8_t {
+  STREAM_COUNTERS = 0x01,
+  STREAM_TRACE = 0x02,
+};
+
+enum TelemetryHistogram : uint8_t {
+  HISTOGRAM_SCAN_CYCLES = 0,
+};
+
+// the values are the wire format and what tools/trace2json reads, a new
+// event gets a new number and an old number is never reused
+enum TraceEvent : uint8_t {
+  TRACE_BUTTON = 1, // packed into the report, slot = button id, arg = pressed
+  TRACE_REPORT = 2, // sent, arg = number of reports sent so far (low 16 bits)
+  TRACE_EDGE = 3,   // raw level change seen by a scan, arg = pin level
+  TRACE_ACCEPT = 4, // debounced change of an input slot, arg = pressed
+  TRACE_TIMER = 5,  // deferred actions fired, arg = how many
+  TRACE_CLOCK = 6,  // arg = cycle counter rate in MHz, sent about every second
+};
+
+struct __attribute__((packed)) TelemetryPacket {
+  uint8_t type;
+  uint8_t seq;
+  uint8_t length; // used bytes of payload
+  uint8_t flags;
+  uint8_t payload[TELEMETRY_PAYLOAD_SIZE];
+};
+
+struct __attribute__((packed)) CountersPayload {
+  uint32_t millis;
+  uint32_t scans;
+  uint32_t events;
+  uint32_t reports;
+  uint32_t dropped; // telemetry packets lost to a full ring
+};
+
+struct __attribute__((packed)) HistogramPayload {
+  uint8_t id;
+  uint8_t first; // index of bins[0] in the full histogram
+  uint8_t count;
+  uint8_t reserved;
+  uint32_t bins[TELEMETRY_HISTOGRAM_BINS];
+};
+
+struct __attribute__((packed)) TraceRecord {
+  uint32_t cycles; // ARM_DWT_CYCCNT, wraps every few seconds
+  uint8_t event;
+  uint8_t slot;
+  uint16_t arg;
+};
+
+struct __attribute__((packed)) SubscribePayload {
+  uint8_t streams; // TelemetryStream bits, 0 stops everything
+};
+
+struct __attribute__((packed)) AckPayload {
+  uint8_t type;   // the request being answered
+  uint8_t status; // 0 = ok
+};
+
+static_assert(sizeof(TelemetryPacket) == TELEMETRY_PACKET_SIZE,
+              "a packet is one HID report");
+static_assert(sizeof(HistogramPayload) <= TELEMETRY_PAYLOAD_SIZE,
+              "histogram fits a packet");
+static_assert(sizeof(TraceRecord) * TELEMETRY_TRACE_RECORDS <=
+                  TELEMETRY_PAYLOAD_SIZE,
+              "trace records fit a packet");
+
+/**
+ * Single producer, single consumer ring of packets. Producers fill a slot in
+ * place and publish it, the consumer sends the slot it gets from front()
+ * directly, so the only copy of a packet is the one the USB stack makes into
+ * its transmit buffer.
+ */
+template <uint8_t N> class PacketRing {
+  static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+
+public:
+  TelemetryPacket *acquire() {
+    return (uint8_t)(head - tail) < N ? &slots[head & (N - 1)] : nullptr;
+  }
+  void publish() { head++; }
+  TelemetryPacket *front() {
+    return head != tail ? &slots[tail & (N - 1)] : nullptr;
+  }
+  void pop() { tail++; }
+  bool empty() const { return head == tail; }
+
+private:
+  TelemetryPacket slots[N] __attribute__((aligned(32)));
+  volatile uint8_t head = 0;
+  volatile uint8_t tail = 0;
+};
+
+#endif // TELEMETRY_H
@@ -0,0 +1,78 @@
+#ifndef TELEMETRY_PORT_H
+#define TELEMETRY_PORT_H
+
+#include <Arduino.h>
+
+#include "layout_store.h"
+#include "telemetry.h"
+
+#ifndef TELEMETRY_RING_PACKETS
+#define TELEMETRY_RING_PACKETS 16
+#endif
+
+#ifndef TELEMETRY_COUNTERS_MS
+#define TELEMETRY_COUNTERS_MS 100
+#endif
+
+// a clock record lets the host unwrap the cycle counter, which it can only
+// do with at least one record per wrap
+#ifndef TELEMETRY_CLOCK_MS
+#define TELEMETRY_CLOCK_MS 1000
+#endif
+
+// give up on a host that took no packet for this long while there was one
+#ifndef TELEMETRY_STALL_MS
+#define TELEMETRY_STALL_MS 250
+#endif
+
+/**
+ * Device end of the raw HID telemetry channel. Polled from loop(), sends at
+ * most one packet per poll, only into a free transmit slot and only while
+ * the host is subscribed, so nothing piles up in the USB stack when no tool
+ * is listening and a busy endpoint never holds the scan up. Without
+ * BUTTONBOX_RAWHID everything here compiles to nothing.
+ */
+class TelemetryPort {
+public:
+#if defined(RAWHID_INTERFACE)
+  void poll();
+  bool tracing() const { return streams & STREAM_TRACE; }
+  // cycles is when it happened, if that was not just now
+  void trace(uint8_t event, uint8_t slot, uint16_t arg,
+             uint32_t cycles = ARM_DWT_CYCCNT) {
+    if (streams & STREAM_TRACE) {
+      appendTrace(event, slot, arg, cycles);
+    }
+  }
+
+private:
+  TelemetryPacket *acquire(uint8_t type);
+  void publish(TelemetryPacket *p);
+  void appendTrace(uint8_t event, uint8_t slot, uint16_t arg,
+                   uint32_t cycles);
+  void traceClock();
+  void closeTrace();
+  void receive(const TelemetryPacket &p);
+  void sendCounters();
+  void ack(uint8_t type, uint8_t status);
+
+  PacketRing<TELEMETRY_RING_PACKETS> ring;
+  TelemetryPacket *openTrace = nullptr;
+  LayoutReceiver layoutReceiver;
+  uint8_t streams = 0;
+  uint8_t seq = 0;
+  uint32_t dropped = 0;
+  uint32_t lastCountersMs = 0;
+  uint32_t lastClockMs = 0;
+  uint32_t lastSentMs = 0;
+#else
+  void poll() {}
+  bool tracing() const { return false; }
+  void trace(uint8_t event, uint8_t slot, uint16_t arg,
+             uint32_t cycles = 0) {}
+#endif
+};
+
+extern TelemetryPort telemetryPort;
+
+#endif // TELEMETRY_PORT_H
@@ -0,0 +1,51 @@
+#ifndef USB_RESYNC_H
+#define USB_RESYNC_H
+
+#include <Arduino.h>
+
+#include "stats.h"
+
+// resend the whole report this often even without changes, 0 = never
+#ifndef RESYNC_KEEPALIVE_MS
+#define RESYNC_KEEPALIVE_MS 0
+#endif
+
+/**
+ * Pushes the complete joystick image whenever the host may have lost it:
+ * after enumeration, after a bus reset and after resume. The image itself
+ * always follows the debounced state, also while nothing can be sent, so
+ * resending it is enough to bring the host back in line with the switches.
+ *
+ * A host that reopens the device without any bus event can ask for the
+ * image with HID GET_REPORT, which extra_script.py patches into the core's
+ * usb.c (see usb_joystick_get_report()). RESYNC_KEEPALIVE_MS covers hosts
+ * that never ask.
+ *
+ * The latency runs from SET_CONFIGURATION, stamped by the USB interrupt in
+ * usb_joystick_configure(), so it holds the whole wait for the task. A
+ * resume has no such hook outside usb.c; it is stamped by the poll that
+ * finds SUSP cleared, which leaves out up to one loop pass.
+ */
+class UsbResync {
+public:
+  void poll();
+
+  uint32_t resyncs = 0;
+  uint32_t resumes = 0;
+  uint32_t keepalives = 0;
+  Histogram latency; // us from enumeration or resume to the full report
+
+private:
+  bool sendAll();
+
+  bool wasUp = false;
+  bool wasSuspended = false;
+  bool pending = false;
+  bool timed = false; // eventUs holds an unreported stamp
+  uint32_t eventUs = 0;
+  uint32_t lastSendMs = 0;
+};
+
+extern UsbResync usbResync;
+
+#endif // USB_RESYNC_H
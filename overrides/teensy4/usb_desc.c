@@ -279,26 +279,8 @@ static uint8_t mouse_report_desc[] = {
 #endif
 
 #ifdef JOYSTICK_INTERFACE
-#if JOYSTICK_SIZE == 7
-static uint8_t joystick_report_desc[] = {
-        0x05, 0x01,                     // Usage Page (Generic Desktop)
-        0x09, 0x05,                     // Usage (Joystick)
-        0xA1, 0x01,                     // Collection (Application)
-        0x05, 0x09,                     //   Usage Page (Button)
-        0x15, 0x00,                     //   Logical Minimum (0)
-        0x25, 0x01,                     //   Logical Maximum (1)
-        0x75, 0x01,                     //   Report Size (1)
-        0x95, 0x38,                     //   Report Count (56)
-        0x19, 0x01,                     //   Usage Minimum (Button #1)
-        0x29, 0x38,                     //   Usage Maximum (Button #56)
-        0x81, 0x02,                     //   Input (variable,absolute)
-
-        0x05, 0x01,                     //   Usage Page (Generic Desktop)
-        0xA1, 0x00,                     //   Collection ()
-        0x09, 0x01,                     //   Usage (Pointer)
-        0xC0,                           //   End Collection
-        0xC0                            // End Collection
-};
+#if JOYSTICK_SIZE == 7 || JOYSTICK_SIZE == 16
+#include "usb_joystick_desc.h"
 #elif JOYSTICK_SIZE == 12
 static uint8_t joystick_report_desc[] = {
         0x05, 0x01,                     // Usage Page (Generic Desktop)
@@ -289,7 +289,11 @@ let me know?  http://forum.pjrc.com/forums/4-Suggestions-amp-Bug-Reports
   #define PRODUCT_NAME_LEN	20
   #define EP0_SIZE		64
   #define NUM_ENDPOINTS		7
+#if defined(BUTTONBOX_RAWHID)
+  #define NUM_INTERFACE		4
+#else
   #define NUM_INTERFACE		3
+#endif
   #define CDC_IAD_DESCRIPTOR	1
   #define CDC_STATUS_INTERFACE	0
   #define CDC_DATA_INTERFACE	1	// Serial
@@ -303,12 +307,34 @@ let me know?  http://forum.pjrc.com/forums/4-Suggestions-amp-Bug-Reports
   #define CDC_TX_SIZE_12        64
   #define JOYSTICK_INTERFACE    4	// Joystick
   #define JOYSTICK_ENDPOINT     7
+#if defined(BUTTONBOX_EXTREME_JOYSTICK)
+  #define JOYSTICK_SIZE         64	// 128 buttons, used by the layers
+#elif defined(BUTTONBOX_REPORT_IDS)
+  #define JOYSTICK_SIZE         16	// 128 buttons + axes in 3 report ids
+#else
   #define JOYSTICK_SIZE         7	//  12 = normal, 64 = extreme joystick
+#endif
   #define JOYSTICK_INTERVAL     1
+#if defined(BUTTONBOX_RAWHID)
+  // vendor defined 64 byte channel for telemetry and config, see telemetry.h
+  #define RAWHID_USAGE_PAGE	0xFFAB
+  #define RAWHID_USAGE		0x0200
+  #define RAWHID_INTERFACE      2	// RawHID
+  #define RAWHID_TX_ENDPOINT    4
+  #define RAWHID_TX_SIZE        64
+  #define RAWHID_TX_INTERVAL    1
+  #define RAWHID_RX_ENDPOINT    5
+  #define RAWHID_RX_SIZE        64
+  #define RAWHID_RX_INTERVAL    1
+#endif
   #define ENDPOINT2_CONFIG	ENDPOINT_RECEIVE_UNUSED + ENDPOINT_TRANSMIT_INTERRUPT
   #define ENDPOINT3_CONFIG	ENDPOINT_RECEIVE_BULK + ENDPOINT_TRANSMIT_BULK
   #define ENDPOINT4_CONFIG      ENDPOINT_RECEIVE_UNUSED + ENDPOINT_TRANSMIT_INTERRUPT
+#if defined(BUTTONBOX_RAWHID)
+  #define ENDPOINT5_CONFIG	ENDPOINT_RECEIVE_INTERRUPT + ENDPOINT_TRANSMIT_UNUSED
+#else
   #define ENDPOINT5_CONFIG	ENDPOINT_RECEIVE_UNUSED + ENDPOINT_TRANSMIT_INTERRUPT
+#endif
   #define ENDPOINT6_CONFIG      ENDPOINT_RECEIVE_UNUSED + ENDPOINT_TRANSMIT_INTERRUPT
   #define ENDPOINT7_CONFIG	ENDPOINT_RECEIVE_UNUSED + ENDPOINT_TRANSMIT_INTERRUPT
 
@@ -0,0 +1,166 @@
+/* Teensyduino Core Library
+ * http://www.pjrc.com/teensy/
+ * Copyright (c) 2017 PJRC.COM, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * 1. The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * 2. If the Software is incorporated into a build system that allows
+ * selection among a list of target devices, then similar target
+ * devices manufactured by PJRC.COM must be included in the list of
+ * target devices and selectable in the same manner.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "usb_dev.h"
+#include "usb_joystick.h"
+#include "core_pins.h" // for yield()
+#include <string.h> // for memcpy()
+#include "avr/pgmspace.h" // for PROGMEM, DMAMEM, FASTRUN
+
+#ifdef JOYSTICK_INTERFACE // defined by usb_dev.h -> usb_desc.h
+
+#if JOYSTICK_SIZE == 16
+uint32_t usb_joystick_data[7];
+uint8_t usb_joystick_dirty;
+#else
+uint32_t usb_joystick_data[(JOYSTICK_SIZE+3)/4];
+#endif
+
+static uint8_t transmit_previous_timeout=0;
+
+// When the PC isn't listening, how long do we wait before discarding data?
+#define TX_TIMEOUT_MSEC 30
+
+#define TX_NUM   4
+#define TX_BUFSIZE ((JOYSTICK_SIZE + 31) & ~31)	// cache line aligned slots
+static transfer_t tx_transfer[TX_NUM] __attribute__ ((used, aligned(32)));
+DMAMEM static uint8_t txbuffer[TX_NUM * TX_BUFSIZE] __attribute__ ((aligned(32)));
+static uint8_t tx_head=0;
+
+// micros() of the last SET_CONFIGURATION, 0 once the firmware took it
+volatile uint32_t usb_joystick_configured_us;
+
+void usb_joystick_configure(void)
+{
+	memset(tx_transfer, 0, sizeof(tx_transfer));
+	tx_head = 0;
+	usb_config_tx(JOYSTICK_ENDPOINT, JOYSTICK_SIZE, 0, NULL);
+	usb_joystick_configured_us = micros() | 1;
+}
+
+// queue one report of len bytes, waiting for a free slot unless the host
+// already timed out once
+static int usb_joystick_transmit(const void *data, uint32_t len)
+{
+	if (!usb_configuration) return -1;
+	uint32_t wait_begin_at = systick_millis_count;
+	while (1) {
+		if (!usb_configuration) return -1;
+		uint32_t status = usb_transfer_status(tx_transfer + tx_head);
+		if (!(status & 0x80)) {
+			transmit_previous_timeout = 0;
+			break;
+		}
+		if (transmit_previous_timeout) return -1;
+		if (systick_millis_count - wait_begin_at > TX_TIMEOUT_MSEC) {
+			// waited too long, assume the USB host isn't listening
+			transmit_previous_timeout = 1;
+			return -1;
+		}
+		yield();
+	}
+	transfer_t *xfer = tx_transfer + tx_head;
+	uint8_t *buffer = txbuffer + tx_head * TX_BUFSIZE;
+	memcpy(buffer, data, len);
+	usb_prepare_transfer(xfer, buffer, len, 0);
+	arm_dcache_flush_delete(buffer, TX_BUFSIZE);
+	usb_transmit(JOYSTICK_ENDPOINT, xfer);
+	if (++tx_head >= TX_NUM) tx_head = 0;
+	return 0;
+}
+
+#if JOYSTICK_SIZE == 16
+
+// byte offset and length of each section in usb_joystick_data, by report id
+static const uint8_t section_offset[JOYSTICK_REPORT_COUNT] = {0, 8, 16};
+static const uint8_t section_length[JOYSTICK_REPORT_COUNT] = {8, 8, 10};
+
+int usb_joystick_send_report(uint8_t id)
+{
+	uint8_t report[JOYSTICK_SIZE];
+	if (id < 1 || id > JOYSTICK_REPORT_COUNT) return -1;
+	report[0] = id;
+	memcpy(report + 1, (const uint8_t *)usb_joystick_data + section_offset[id - 1],
+		section_length[id - 1]);
+	return usb_joystick_transmit(report, section_length[id - 1] + 1);
+}
+
+// sends only the sections that changed since the last send, a section that
+// could not be sent stays dirty and goes out with the next one
+int usb_joystick_send(void)
+{
+	int ret = 0;
+	for (uint8_t id = 1; id <= JOYSTICK_REPORT_COUNT; id++) {
+		uint8_t bit = 1 << (id - 1);
+		if (!(usb_joystick_dirty & bit)) continue;
+		if (usb_joystick_send_report(id) == 0) {
+			usb_joystick_dirty &= ~bit;
+		} else {
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+#else
+
+int usb_joystick_send(void)
+{
+	return usb_joystick_transmit(usb_joystick_data, JOYSTICK_SIZE);
+}
+
+#endif // JOYSTICK_SIZE
+
+DMAMEM static uint8_t get_report_buffer[TX_BUFSIZE] __attribute__ ((aligned(32)));
+
+// answers HID GET_REPORT from the control endpoint interrupt with the image
+// as it is, wValue is the report type (high byte) and id; returns NULL for a
+// report this interface does not have, which usb.c stalls
+const void * usb_joystick_get_report(uint16_t value, uint32_t *len)
+{
+	if ((value >> 8) != 1) return NULL; // input reports only
+#if JOYSTICK_SIZE == 16
+	uint8_t id = value;
+	if (id < 1 || id > JOYSTICK_REPORT_COUNT) return NULL;
+	get_report_buffer[0] = id;
+	memcpy(get_report_buffer + 1,
+		(const uint8_t *)usb_joystick_data + section_offset[id - 1],
+		section_length[id - 1]);
+	*len = section_length[id - 1] + 1;
+#else
+	if ((value & 0xFF) != 0) return NULL;
+	memcpy(get_report_buffer, usb_joystick_data, JOYSTICK_SIZE);
+	*len = JOYSTICK_SIZE;
+#endif
+	arm_dcache_flush_delete(get_report_buffer, TX_BUFSIZE);
+	return get_report_buffer;
+}
+
+#endif // JOYSTICK_INTERFACE
@@ -43,7 +43,20 @@ extern "C" {
 #endif
 void usb_joystick_configure(void);
 int usb_joystick_send(void);
+const void * usb_joystick_get_report(uint16_t value, uint32_t *len);
+extern volatile uint32_t usb_joystick_configured_us;
+#if JOYSTICK_SIZE == 16
+// report ids of the sections, each one owns a slice of usb_joystick_data
+#define JOYSTICK_REPORT_BUTTONS		1	// buttons 1-64, words 0-1
+#define JOYSTICK_REPORT_ENCODERS	2	// buttons 65-128, words 2-3
+#define JOYSTICK_REPORT_AXES		3	// 5 x 16 bit axes, words 4-6
+#define JOYSTICK_REPORT_COUNT		3
+int usb_joystick_send_report(uint8_t id);
+extern uint32_t usb_joystick_data[7];
+extern uint8_t usb_joystick_dirty;	// bit (id - 1) set = section changed
+#else
 extern uint32_t usb_joystick_data[(JOYSTICK_SIZE+3)/4];
+#endif
 extern volatile uint8_t usb_configuration;
 #ifdef __cplusplus
 }
@@ -202,6 +215,31 @@ class usb_joystick_class
 		}
 		if (!manual_mode) usb_joystick_send();
         }
+#elif JOYSTICK_SIZE == 16
+	void button(unsigned int num, bool val) {
+		if (--num >= 128) return;
+		uint32_t *p = usb_joystick_data + (num >> 5);
+		uint32_t bit = 1 << (num & 0x1F);
+		if (val == !!(*p & bit)) return;
+		if (val) *p |= bit;
+		else *p &= ~bit;
+		usb_joystick_dirty |= 1 << (num >> 6);
+		if (!manual_mode) usb_joystick_send();
+	}
+	void X(unsigned int position) { analog16(0, position); }
+	void Y(unsigned int position) { analog16(1, position); }
+	void position(unsigned int x, unsigned int y) {
+		analog16(0, x);
+		analog16(1, y);
+	}
+	void Z(unsigned int position) { analog16(2, position); }
+	void Zrotate(unsigned int position) { analog16(3, position); }
+	void slider(unsigned int position) { analog16(4, position); }
+	void sliderLeft(unsigned int position) { analog16(4, position); }
+	void sliderRight(unsigned int position) { analog16(4, position); }
+        inline void hat(int dir) {
+            return;
+        }
 #endif
 	void useManualSend(bool mode) {
 		manual_mode = mode;
@@ -218,6 +256,15 @@ class usb_joystick_class
 		p[num] = value;
                 if (!manual_mode) usb_joystick_send();
 	}
+#elif JOYSTICK_SIZE == 16
+	void analog16(unsigned int num, unsigned int value) {
+		if (value > 0xFFFF) value = 0xFFFF;
+		uint16_t *p = (uint16_t *)(&usb_joystick_data[4]);
+		if (p[num] == value) return;
+		p[num] = value;
+		usb_joystick_dirty |= 1 << (JOYSTICK_REPORT_AXES - 1);
+                if (!manual_mode) usb_joystick_send();
+	}
 #endif
 };
 extern usb_joystick_class Joystick;
@@ -0,0 +1,68 @@
+/* Report descriptors of the button box joystick layouts.
+ *
+ * Kept out of usb_desc.c so the host tools can include the very bytes the
+ * device sends (see tools/hiddesc.cpp). No include guard on purpose: a host
+ * tool includes it once per JOYSTICK_SIZE to look at every layout.
+ */
+
+#if JOYSTICK_SIZE == 7
+static uint8_t joystick_report_desc[] = {
+        0x05, 0x01,                     // Usage Page (Generic Desktop)
+        0x09, 0x05,                     // Usage (Joystick)
+        0xA1, 0x01,                     // Collection (Application)
+        0x05, 0x09,                     //   Usage Page (Button)
+        0x15, 0x00,                     //   Logical Minimum (0)
+        0x25, 0x01,                     //   Logical Maximum (1)
+        0x75, 0x01,                     //   Report Size (1)
+        0x95, 0x38,                     //   Report Count (56)
+        0x19, 0x01,                     //   Usage Minimum (Button #1)
+        0x29, 0x38,                     //   Usage Maximum (Button #56)
+        0x81, 0x02,                     //   Input (variable,absolute)
+
+        0x05, 0x01,                     //   Usage Page (Generic Desktop)
+        0xA1, 0x00,                     //   Collection ()
+        0x09, 0x01,                     //   Usage (Pointer)
+        0xC0,                           //   End Collection
+        0xC0                            // End Collection
+};
+#elif JOYSTICK_SIZE == 16
+// one report per section, so a change only resends the section it touched:
+// id 1 = buttons 1-64, id 2 = buttons 65-128 (encoders), id 3 = axes
+static uint8_t joystick_report_desc[] = {
+        0x05, 0x01,                     // Usage Page (Generic Desktop)
+        0x09, 0x04,                     // Usage (Joystick)
+        0xA1, 0x01,                     // Collection (Application)
+        0x85, 0x01,                     //   Report ID (1)
+        0x05, 0x09,                     //   Usage Page (Button)
+        0x15, 0x00,                     //   Logical Minimum (0)
+        0x25, 0x01,                     //   Logical Maximum (1)
+        0x75, 0x01,                     //   Report Size (1)
+        0x95, 0x40,                     //   Report Count (64)
+        0x19, 0x01,                     //   Usage Minimum (Button #1)
+        0x29, 0x40,                     //   Usage Maximum (Button #64)
+        0x81, 0x02,                     //   Input (variable,absolute)
+
+        0x85, 0x02,                     //   Report ID (2)
+        0x95, 0x40,                     //   Report Count (64)
+        0x19, 0x41,                     //   Usage Minimum (Button #65)
+        0x29, 0x80,                     //   Usage Maximum (Button #128)
+        0x81, 0x02,                     //   Input (variable,absolute)
+
+        0x85, 0x03,                     //   Report ID (3)
+        0x05, 0x01,                     //   Usage Page (Generic Desktop)
+        0x09, 0x01,                     //   Usage (Pointer)
+        0xA1, 0x00,                     //   Collection (Physical)
+        0x15, 0x00,                     //     Logical Minimum (0)
+        0x27, 0xFF, 0xFF, 0, 0,         //     Logical Maximum (65535)
+        0x75, 0x10,                     //     Report Size (16)
+        0x95, 0x05,                     //     Report Count (5)
+        0x09, 0x30,                     //     Usage (X)
+        0x09, 0x31,                     //     Usage (Y)
+        0x09, 0x32,                     //     Usage (Z)
+        0x09, 0x35,                     //     Usage (Rz)
+        0x09, 0x36,                     //     Usage (Slider)
+        0x81, 0x02,                     //     Input (variable,absolute)
+        0xC0,                           //   End Collection
+        0xC0                            // End Collection
+};
+#endif
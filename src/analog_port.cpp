@@ -0,0 +1,87 @@
+#include "analog_port.h"
+
+AnalogPort analogPort;
+
+#if AXIS_COUNT > 0
+
+#include <ADC.h>
+#include <AnalogBufferDMA.h>
+
+#include "scanner.h"
+
+#if JOYSTICK_SIZE == 7
+#error "the 56 button report has no axes, add BUTTONBOX_REPORT_IDS"
+#endif
+
+namespace {
+
+const uint8_t AXIS_PINS[] = {AXIS_0_PIN, AXIS_1_PIN};
+
+ADC adc;
+
+DMAMEM volatile uint16_t __attribute__((aligned(32)))
+buffers[AXIS_COUNT][2][AXIS_OVERSAMPLE];
+
+AnalogBufferDMA dma[] = {
+    {buffers[0][0], AXIS_OVERSAMPLE, buffers[0][1], AXIS_OVERSAMPLE},
+#if AXIS_COUNT > 1
+    {buffers[1][0], AXIS_OVERSAMPLE, buffers[1][1], AXIS_OVERSAMPLE},
+#endif
+};
+
+ADC_Module *module(uint8_t axis) { return axis ? adc.adc1 : adc.adc0; }
+
+/**
+ * Sums the buffer the DMA just finished, which is the decimated sample.
+ */
+uint16_t decimate(AnalogBufferDMA &d) {
+  volatile uint16_t *p = d.bufferLastISRFilled();
+  uint16_t count = d.bufferCountLastISRFilled();
+  // the buffers sit in cached RAM, drop the stale lines before reading
+  arm_dcache_delete((void *)p, sizeof(buffers[0][0]));
+  uint32_t sum = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    sum += p[i];
+  }
+  d.clearInterrupt();
+  return sum < 65535 ? sum : 65535;
+}
+
+} // namespace
+
+void AnalogPort::begin() {
+  for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+    ADC_Module *m = module(a);
+    m->setResolution(12);
+    m->setAveraging(1);
+    m->setConversionSpeed(ADC_CONVERSION_SPEED::HIGH_SPEED);
+    m->setSamplingSpeed(ADC_SAMPLING_SPEED::HIGH_SPEED);
+    filters[a].configure(AXIS_DEFAULT_CONFIG);
+    filters[a].reset(m->analogRead(AXIS_PINS[a]) * AXIS_OVERSAMPLE);
+
+    dma[a].init(&adc, a ? ADC_1 : ADC_0);
+    m->startSingleRead(AXIS_PINS[a]);
+    m->startTimer(AXIS_SAMPLE_HZ);
+    joystickSink.axis(a, filters[a].output);
+  }
+}
+
+/**
+ * Filters every decimated sample that came in since the last poll and sends
+ * the axes that moved in one report.
+ */
+void AnalogPort::poll() {
+  bool moved = false;
+  for (uint8_t a = 0; a < AXIS_COUNT; a++) {
+    if (dma[a].interrupted() && filters[a].update(decimate(dma[a]))) {
+      joystickSink.axis(a, filters[a].output);
+      moved = true;
+    }
+  }
+  if (moved) {
+    reports++;
+    joystickSink.flush();
+  }
+}
+
+#endif
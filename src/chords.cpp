@@ -0,0 +1,174 @@
+#include "chords.h"
+
+#include <string.h>
+
+#include "deferred.h"
+
+ChordMatcher chords;
+
+/**
+ * Sets the chord table, normally a const array in flash. A chord that
+ * contains another one must come first, or the smaller one wins.
+ */
+void ChordMatcher::define(const ChordDef *defs, uint8_t count) {
+  this->defs = defs;
+  this->count = count < CHORD_MAX ? count : CHORD_MAX;
+}
+
+/**
+ * Resolves the button ids of every chord to input slots of the layout that
+ * just became active. Chords with a button the layout lacks are dropped.
+ */
+void ChordMatcher::configure(const LayoutTable &t) {
+  end();
+  memset(members, 0, sizeof(members));
+  chords = 0;
+  for (uint8_t c = 0; c < count; c++) {
+    uint64_t m[INPUT_WORDS] = {};
+    uint8_t keys = 0;
+    bool found = true;
+    for (uint8_t k = 0; k < CHORD_MAX_KEYS && defs[c].keys[k]; k++, keys++) {
+      bool hit = false;
+      for (uint8_t slot = 0; slot < t.blob.header.count; slot++) {
+        uint64_t bit = 1ULL << (slot & 63);
+        if (t.blob.entries[slot].button == defs[c].keys[k] &&
+            (t.inputMask[slot >> 6] & bit)) {
+          m[slot >> 6] |= bit;
+          hit = true;
+        }
+      }
+      found &= hit;
+    }
+    if (!found || keys < 2) {
+      continue;
+    }
+    for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+      mask[chords][w] = m[w];
+      members[w] |= m[w];
+    }
+    button[chords++] = defs[c].button;
+  }
+}
+
+/**
+ * Releases every chord that is down and forgets what is held back, used when
+ * the layer or the layout changes and the pipeline re-presses everything.
+ */
+void ChordMatcher::end() {
+  for (uint8_t c = 0; c < chords; c++) {
+    if (active & (1UL << c)) {
+      sink->button(button[c], false);
+    }
+  }
+  active = 0;
+  memset(pending, 0, sizeof(pending));
+  memset(consumed, 0, sizeof(consumed));
+  memset(late, 0, sizeof(late));
+  memset(fresh, 0, sizeof(fresh));
+  holding = false;
+}
+
+void ChordMatcher::filter(uint64_t *down, uint64_t *up,
+                          const uint64_t *stable) {
+  uint64_t released = 0, memberDown = 0, wasFresh = 0, isFresh = 0;
+  uint64_t wasPending = 0, isPending = 0;
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    wasFresh |= fresh[w];
+    wasPending |= pending[w];
+  }
+  // a window that ran out lets go of its held back presses below, and its
+  // presses can no longer start a chord
+  bool expired = wasFresh && deferred.now() - windowStart >= windowMs;
+  if (expired) {
+    memset(fresh, 0, sizeof(fresh));
+    timeouts += wasPending != 0;
+    wasFresh = 0;
+  }
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    released |= up[w] & members[w];
+    memberDown |= down[w] & members[w];
+    fresh[w] = (fresh[w] | (down[w] & members[w])) & ~up[w];
+    isFresh |= fresh[w];
+  }
+  if (isFresh && !wasFresh) {
+    windowStart = deferred.now();
+  }
+
+  if (released) {
+    for (uint8_t c = 0; c < chords; c++) {
+      if (!(active & (1UL << c))) {
+        continue;
+      }
+      uint64_t hit = 0;
+      for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+        hit |= up[w] & mask[c][w];
+      }
+      if (hit) {
+        sink->button(button[c], false);
+        active &= ~(1UL << c);
+      }
+    }
+  }
+
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    // a tap that was held back goes down now and up in the next scan
+    up[w] |= late[w];
+    late[w] = 0;
+    uint64_t gone = up[w] & consumed[w];
+    consumed[w] &= ~gone;
+    up[w] &= ~gone;
+    uint64_t tap = up[w] & pending[w];
+    pending[w] &= ~tap;
+    up[w] &= ~tap;
+    down[w] |= tap;
+    late[w] = tap;
+    uint64_t timedOut = expired ? pending[w] : 0;
+    pending[w] &= ~timedOut;
+
+    if (suppress) {
+      uint64_t held = down[w] & members[w] & ~tap;
+      pending[w] |= held;
+      down[w] &= ~held;
+    }
+    down[w] |= timedOut;
+  }
+
+  if (memberDown) {
+    match(stable);
+  }
+
+  uint64_t tapping = 0;
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    isPending |= pending[w];
+    tapping |= late[w];
+  }
+  holding = isPending || tapping;
+}
+
+/**
+ * Only inputs pressed inside the current window count: one held down since
+ * long before the others already went out as itself and starts no chord.
+ */
+void ChordMatcher::match(const uint64_t *stable) {
+  for (uint8_t c = 0; c < chords; c++) {
+    if (active & (1UL << c)) {
+      continue;
+    }
+    bool all = true;
+    for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+      all &= (stable[w] & fresh[w] & mask[c][w]) == mask[c][w];
+    }
+    if (!all) {
+      continue;
+    }
+    active |= 1UL << c;
+    matched++;
+    sink->button(button[c], true);
+    // inputs whose own press already went out keep their own release
+    for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+      consumed[w] |= pending[w] & mask[c][w];
+      pending[w] &= ~mask[c][w];
+      fresh[w] &= ~mask[c][w];
+    }
+  }
+}
@@ -0,0 +1,540 @@
+#include "console.h"
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analog_port.h"
+#include "chords.h"
+#include "deferred.h"
+#include "edge_capture.h"
+#include "encoder_port.h"
+#include "gestures.h"
+#include "input_counters.h"
+#include "link_port.h"
+#include "macros.h"
+#include "profiler.h"
+#include "scanner.h"
+#include "stats.h"
+#include "usb_resync.h"
+
+#define CONSOLE_REPORT_BYTES_PER_LINE 16
+
+#if JOYSTICK_SIZE == 16
+// with report ids the image holds all sections, not just one report
+#define CONSOLE_REPORT_BYTES sizeof(usb_joystick_data)
+#else
+#define CONSOLE_REPORT_BYTES JOYSTICK_SIZE
+#endif
+
+Console console;
+
+namespace {
+
+const char *const HELP[] = {
+    "stats          scan counters and scan time histogram",
+    "inputs         presses, edges and bounces of every input",
+    "latency        press latency of eager and settled inputs",
+    "capture [s..]  raw edges of up to 8 slots, capture stop ends it",
+    "dump           the captured edges, for tools/bounce",
+    "clear          reset the counters",
+    "debounce [ms]  show or set the debounce time",
+    "profile n [p r e] debounce profile n, press and release ms, e = eager",
+    "scan [us]      show or set the scan interval",
+    "pulse [ms]     show or set the encoder pulse width",
+    "report         dump the joystick report",
+    "layout         show the active layout",
+    "encoders       detents, logical steps and timer use",
+    "encoder n [r d] reversal window and dwell (us) of encoder n",
+    "intervals      encoder transition interval histogram",
+    "gestures [h l d] hold, long press and double tap times (ms)",
+    "chords [ms [s]] chord window, s = 0 lets member presses through",
+    "macros         running macros and step timing error histogram",
+    "macro n        run macro n",
+    "usb            full report resyncs, latency from enumeration or resume",
+#if PROFILE_ENABLED
+    "tasks          cycles per loop job and loop period histogram",
+#endif
+#if LINK_MODE > 0
+    "link           box to box link frames and errors",
+#endif
+#if MCP23017_CHIPS > 0
+    "expander       expander reads, errors and latency",
+#endif
+#if AXIS_COUNT > 0
+    "axes           filtered and reported axis values",
+#endif
+#if SHIFT_CHIPS > 0
+    "shift          shift register samples and overruns",
+#endif
+};
+
+// whether a window of the blob's profiles or the global time is longer
+// than the debouncers hold at the current scan rate
+bool clamps(const LayoutBlob &blob) {
+  uint16_t max = pipeline.maxDebounceMs();
+  bool any = scanner.debounceMillis() > max;
+  for (const DebounceProfile &d : blob.header.debounce) {
+    any |= d.pressMs > max || d.releaseMs > max;
+  }
+  return any;
+}
+
+} // namespace
+
+void Console::poll() {
+  uint32_t start = ARM_DWT_CYCCNT;
+  uint32_t budget = CONSOLE_BUDGET_US * (F_CPU_ACTUAL / 1000000);
+
+  if (outLength == 0 && job != JOB_NONE && !next()) {
+    job = JOB_NONE;
+  }
+  if (outLength) {
+    if (Serial.availableForWrite() >= outLength) {
+      Serial.write((const uint8_t *)out, outLength);
+      outLength = 0;
+    }
+    return;
+  }
+
+  while (job == JOB_NONE && outLength == 0 && Serial.available() &&
+         ARM_DWT_CYCCNT - start < budget) {
+    uint8_t b = Serial.read();
+    if (layoutReceiver.receiving() || b == LAYOUT_FRAME_START) {
+      LayoutReceiver::Result result = layoutReceiver.feed(b, millis());
+      if (result == LayoutReceiver::DONE && clamps(layout.staging())) {
+        reply("layout received, windows over %u ms are clamped",
+              pipeline.maxDebounceMs());
+      } else if (result == LayoutReceiver::DONE) {
+        reply("layout received");
+      } else if (result == LayoutReceiver::FAILED) {
+        reply("layout rejected");
+      }
+    } else {
+      receive(b);
+    }
+  }
+}
+
+void Console::receive(char c) {
+  if (c == '\r' || c == '\n') {
+    line[lineLength] = 0;
+    if (lineLength) {
+      execute();
+    }
+    lineLength = 0;
+  } else if (lineLength < CONSOLE_LINE_LENGTH - 1) {
+    line[lineLength++] = c;
+  }
+}
+
+void Console::execute() {
+  char *arg = strchr(line, ' ');
+  bool hasArg = arg != NULL;
+  if (hasArg) {
+    *arg++ = 0;
+  }
+  unsigned long value = hasArg ? strtoul(arg, NULL, 10) : 0;
+
+  if (strcmp(line, "help") == 0) {
+    start(JOB_HELP);
+  } else if (strcmp(line, "stats") == 0) {
+    start(JOB_STATS);
+  } else if (strcmp(line, "inputs") == 0) {
+    start(JOB_INPUTS);
+  } else if (strcmp(line, "latency") == 0) {
+    start(JOB_LATENCY);
+  } else if (strcmp(line, "capture") == 0) {
+    if (hasArg && strcmp(arg, "stop") == 0) {
+      edgeCapture.stop();
+    } else if (hasArg) {
+      uint8_t slots[CAPTURE_MAX_PINS];
+      uint8_t count = 0;
+      for (char *p = arg; *p && count < CAPTURE_MAX_PINS;) {
+        char *end;
+        unsigned long slot = strtoul(p, &end, 10);
+        if (end == p) {
+          break;
+        }
+        slots[count++] = slot;
+        p = end;
+      }
+      edgeCapture.start(slots, count);
+    }
+    reply("capture %s: %u pins, %u edges, %lu lost",
+          edgeCapture.running() ? "running" : "stopped", edgeCapture.pinCount(),
+          edgeCapture.count(), edgeCapture.lost());
+  } else if (strcmp(line, "dump") == 0) {
+    // a capture that keeps running could outpace the dump forever
+    edgeCapture.stop();
+    start(JOB_CAPTURE);
+  } else if (strcmp(line, "clear") == 0) {
+    scanStats.clear();
+    inputCounters.clear();
+    encoderPort.intervals.clear();
+    macros.error.clear();
+    profiler.clear();
+    reply("cleared");
+  } else if (strcmp(line, "debounce") == 0) {
+    if (hasArg) {
+      scanner.setDebounceMillis(min(value, 1000UL));
+    }
+    reply("debounce %u ms, %u samples%s", scanner.debounceMillis(),
+          pipeline.debounceSamples(),
+          scanner.debounceMillis() > pipeline.maxDebounceMs() ? ", clamped"
+                                                               : "");
+  } else if (strcmp(line, "profile") == 0 && hasArg &&
+             value < LAYOUT_PROFILES) {
+    char *more = strchr(arg, ' ');
+    if (more) {
+      LayoutBlob &blob = beginLayoutEdit();
+      DebounceProfile &d = blob.header.debounce[value];
+      d.pressMs = min(strtoul(more, &more, 10), 255UL);
+      if (*more) {
+        d.releaseMs = min(strtoul(more, &more, 10), 255UL);
+      }
+      if (*more) {
+        d.flags = strtoul(more, NULL, 10) ? DEBOUNCE_EAGER : 0;
+      }
+      finishLayoutEdit();
+    }
+    // an edit is swapped in by the next scan
+    const LayoutBlob &blob = more ? layout.staging() : layout.active().blob;
+    const DebounceProfile &d = blob.header.debounce[value];
+    // an eager profile's press window is the lockout after every change,
+    // which the planes clamp like any window
+    const char *press = d.flags & DEBOUNCE_EAGER ? "eager, lockout" : "press";
+    uint16_t max = pipeline.maxDebounceMs();
+    if (d.pressMs > max || d.releaseMs > max) {
+      reply("profile %lu: %s %u ms, release %u ms, clamped to %u ms", value,
+            press, d.pressMs, d.releaseMs, max);
+    } else {
+      reply("profile %lu: %s %u ms, release %u ms (0 = %u ms)", value, press,
+            d.pressMs, d.releaseMs, scanner.debounceMillis());
+    }
+  } else if (strcmp(line, "scan") == 0) {
+    if (hasArg) {
+      scanner.setScanMicros(constrain(value, 100UL, 10000UL));
+    }
+    if (clamps(layout.active().blob)) {
+      reply("scan %lu us, windows over %u ms are clamped", scanner.scanMicros(),
+            pipeline.maxDebounceMs());
+    } else {
+      reply("scan %lu us", scanner.scanMicros());
+    }
+  } else if (strcmp(line, "pulse") == 0) {
+    if (hasArg) {
+      beginLayoutEdit().header.pulseMs = constrain(value, 1UL, 1000UL);
+      finishLayoutEdit();
+    }
+    reply("pulse %u ms", hasArg ? layout.staging().header.pulseMs
+                                : layout.pulseMs());
+  } else if (strcmp(line, "report") == 0) {
+    start(JOB_REPORT);
+  } else if (strcmp(line, "layout") == 0) {
+    const LayoutHeader &h = layout.active().blob.header;
+    reply("layout %u entries, pulse %u ms, crc %08lx, generation %u", h.count,
+          h.pulseMs, h.crc, layout.generation());
+  } else if (strcmp(line, "encoder") == 0 && hasArg &&
+             value < encoderPort.encoders()) {
+    DetentFilter &f = encoderPort.filter(value);
+    char *more = strchr(arg, ' ');
+    if (more) {
+      f.reversalUs = strtoul(more, &more, 10);
+      if (*more) {
+        f.dwellUs = strtoul(more, NULL, 10);
+      }
+    }
+    reply("encoder %lu: reversal %lu us, dwell %lu us, rejected %lu "
+          "reversals, %lu bounces",
+          value, f.reversalUs, f.dwellUs, f.reversals, f.bounces);
+  } else if (strcmp(line, "gestures") == 0) {
+    if (hasArg) {
+      char *more = arg;
+      gestures.holdMs = strtoul(more, &more, 10);
+      if (*more) {
+        gestures.longMs = strtoul(more, &more, 10);
+      }
+      if (*more) {
+        gestures.doubleMs = strtoul(more, NULL, 10);
+      }
+    }
+    reply("gestures: hold %u ms, long %u ms, double %u ms, %lu emitted, "
+          "%lu dropped",
+          gestures.holdMs, gestures.longMs, gestures.doubleMs,
+          gestures.emitted, gestures.dropped);
+  } else if (strcmp(line, "chords") == 0) {
+    if (hasArg) {
+      char *more = arg;
+      chords.windowMs = strtoul(more, &more, 10);
+      if (*more) {
+        chords.suppress = strtoul(more, NULL, 10) != 0;
+      }
+    }
+    reply("chords: window %u ms, %s, %lu matched, %lu timed out",
+          chords.windowMs, chords.suppress ? "suppressing" : "passing",
+          chords.matched, chords.timeouts);
+  } else if (strcmp(line, "macros") == 0) {
+    start(JOB_MACROS);
+  } else if (strcmp(line, "macro") == 0 && hasArg) {
+    reply(macros.start(value) ? "macro %lu started" : "macro %lu not started",
+          value);
+#if PROFILE_ENABLED
+  } else if (strcmp(line, "tasks") == 0) {
+    start(JOB_TASKS);
+#endif
+  } else if (strcmp(line, "usb") == 0) {
+    const Histogram &h = usbResync.latency;
+    reply("usb resyncs %lu, %lu after resume, to report %lu-%lu us, "
+          "keepalives %lu",
+          usbResync.resyncs, usbResync.resumes, h.count ? h.min : 0, h.max,
+          usbResync.keepalives);
+#if LINK_MODE == 2
+  } else if (strcmp(line, "link") == 0) {
+    const LinkDecoder &rx = linkPort.decoder();
+    const Histogram &h = linkPort.frameUs;
+    reply("link %s: frames %lu, crc errors %lu, gaps %lu, junk %lu, "
+          "timeouts %lu, merge %lu-%lu us",
+          rx.synced() ? "up" : "down", rx.frames, rx.crcErrors, rx.gaps,
+          rx.junk, linkPort.timeouts, h.count ? h.min : 0, h.max);
+#elif LINK_MODE == 1
+  } else if (strcmp(line, "link") == 0) {
+    const LinkEncoder &tx = linkPort.encoder();
+    reply("link: frames %lu, full %lu, stalls %lu", tx.frames, tx.fullFrames,
+          linkPort.stalls);
+#endif
+  } else if (strcmp(line, "intervals") == 0) {
+    start(JOB_INTERVALS);
+  } else if (strcmp(line, "encoders") == 0) {
+    reply("detents %lu, steps %lu, timers %u used, %lu overflows",
+          encoderPort.detents, encoderPort.steps, deferred.used(),
+          deferred.overflows);
+#if MCP23017_CHIPS > 0
+  } else if (strcmp(line, "expander") == 0) {
+    const ExpanderChain &x = expanderPort.stats();
+    uint32_t perUs = F_CPU_ACTUAL / 1000000;
+    reply("expander reads %lu, errors %lu, data %lu-%lu us, report %lu-%lu us",
+          x.reads, x.errors, x.edgeToData.count ? x.edgeToData.min / perUs : 0,
+          x.edgeToData.max / perUs,
+          x.edgeToReport.count ? x.edgeToReport.min / perUs : 0,
+          x.edgeToReport.max / perUs);
+#endif
+#if AXIS_COUNT > 0
+  } else if (strcmp(line, "axes") == 0) {
+    const AxisFilter &a = analogPort.filter(0);
+#if AXIS_COUNT > 1
+    const AxisFilter &b = analogPort.filter(1);
+    reply("axes %u/%u, %u/%u, reports %lu", a.filtered(), a.output,
+          b.filtered(), b.output, analogPort.reports);
+#else
+    reply("axis %u/%u, reports %lu", a.filtered(), a.output,
+          analogPort.reports);
+#endif
+#endif
+#if SHIFT_CHIPS > 0
+  } else if (strcmp(line, "shift") == 0) {
+    reply("shift %u chips, samples %lu, overruns %lu", SHIFT_CHIPS,
+          shiftChain.stats().samples, shiftChain.stats().overruns);
+#endif
+  } else {
+    reply("unknown command, try help");
+  }
+}
+
+void Console::start(Job job) {
+  this->job = job;
+  step = 0;
+}
+
+/**
+ * Produces the next line of the running job, returns false when it is done.
+ */
+bool Console::next() {
+  switch (job) {
+  case JOB_HELP:
+    if (step >= sizeof(HELP) / sizeof(HELP[0])) {
+      return false;
+    }
+    reply("%s", HELP[step++]);
+    return true;
+
+  case JOB_STATS: {
+    const Histogram &h = scanStats.scanCycles;
+    if (step == 0) {
+      reply("scans %lu, events %lu, reports %lu", scanStats.scans,
+            scanStats.events, scanStats.reports);
+    } else if (step == 1) {
+      reply("scan cycles min %lu, max %lu", h.count ? h.min : 0, h.max);
+    } else {
+      return histogramLine(h, "cycles", 2);
+    }
+    step++;
+    return true;
+  }
+
+  case JOB_INTERVALS: {
+    const Histogram &h = encoderPort.intervals;
+    if (step == 0) {
+      reply("encoder transitions %lu, min %lu us, max %lu us", h.count,
+            h.count ? h.min : 0, h.max);
+      step++;
+      return true;
+    }
+    return histogramLine(h, "us", 1);
+  }
+
+  case JOB_MACROS: {
+    const Histogram &h = macros.error;
+    if (step == 0) {
+      reply("macros %u, running %u, started %lu, dropped %lu, steps %lu, "
+            "error max %lu us",
+            macros.count(), macros.running(), macros.started, macros.dropped,
+            h.count, h.max);
+      step++;
+      return true;
+    }
+    return histogramLine(h, "us", 1);
+  }
+
+  case JOB_INPUTS: {
+    if (step == 0) {
+      reply("slot button  presses    edges rejected longest");
+      step++;
+      return true;
+    }
+    // one line per input that saw any edge, step - 1 is the next slot
+    uint8_t slot = step - 1;
+    while (slot < layout.count() && inputCounters.slot(slot).edges == 0) {
+      slot++;
+    }
+    if (slot >= layout.count()) {
+      return false;
+    }
+    const InputCounter &c = inputCounters.slot(slot);
+    reply("%4u %6u %8lu %8lu %8lu %7u", slot, layout.entry(slot).button,
+          c.presses, c.edges, c.rejected(), c.longest);
+    step = slot + 2;
+    return true;
+  }
+
+  case JOB_LATENCY: {
+    // the eager histogram comes first, the settled one from step second on
+    const uint16_t second = HISTOGRAM_BINS + 2;
+    bool eager = step < second;
+    const Histogram &h =
+        eager ? inputCounters.eagerLatency : inputCounters.settledLatency;
+    if (step == 0 || step == second) {
+      uint32_t us = scanner.scanMicros();
+      reply("%s presses %lu, min %lu us, max %lu us",
+            eager ? "eager" : "settled", h.count, h.count ? h.min * us : 0,
+            h.max * us);
+      step++;
+      return true;
+    }
+    if (histogramLine(h, "scans", eager ? 1 : second + 1)) {
+      return true;
+    }
+    if (eager) {
+      step = second;
+      return next();
+    }
+    return false;
+  }
+
+#if PROFILE_ENABLED
+  case JOB_TASKS: {
+    // a header, one line per task, the loop period and its histogram
+    if (step == 0) {
+      reply("task         calls      avg      min      max cycles");
+    } else if (step <= TASK_COUNT) {
+      const TaskProfile &t = profiler.task(step - 1);
+      reply("%-9s %8lu %8lu %8lu %8lu", Profiler::name(step - 1), t.calls,
+            t.calls ? uint32_t(t.total / t.calls) : 0, t.calls ? t.min : 0,
+            t.max);
+    } else if (step == TASK_COUNT + 1) {
+      const Histogram &h = profiler.loopPeriod;
+      reply("loop periods %lu, min %lu, max %lu cycles", h.count,
+            h.count ? h.min : 0, h.max);
+    } else {
+      return histogramLine(profiler.loopPeriod, "cycles", TASK_COUNT + 2);
+    }
+    step++;
+    return true;
+  }
+#endif
+
+  case JOB_CAPTURE: {
+    uint8_t pins = edgeCapture.pinCount();
+    if (step == 0) {
+      reply("capture %u edges, %lu lost, %lu Hz", edgeCapture.count(),
+            edgeCapture.lost(), F_CPU_ACTUAL);
+    } else if (step <= pins) {
+      uint8_t slot = edgeCapture.slot(step - 1);
+      const LayoutEntry &e = layout.entry(slot);
+      reply("input %u %s %u %u", slot, EdgeCapture::className(slot), e.button,
+            (e.flags & FLAG_INVERT) != 0);
+    } else if (step - pins - 1 < edgeCapture.count()) {
+      const EdgeRecord &r = edgeCapture.record(step - pins - 1);
+      reply("edge %lu %u %u", r.cycles, r.slot, r.level);
+    } else if (step - pins - 1 == edgeCapture.count()) {
+      reply("end");
+    } else {
+      return false;
+    }
+    step++;
+    return true;
+  }
+
+  case JOB_REPORT: {
+    const uint8_t *report = (const uint8_t *)usb_joystick_data;
+    uint8_t offset = step * CONSOLE_REPORT_BYTES_PER_LINE;
+    if (offset >= CONSOLE_REPORT_BYTES) {
+      return false;
+    }
+    int n = snprintf(out, sizeof(out), "report %02u:", offset);
+    for (uint8_t i = offset;
+         i < CONSOLE_REPORT_BYTES && i < offset + CONSOLE_REPORT_BYTES_PER_LINE; i++) {
+      n += snprintf(out + n, sizeof(out) - n, " %02x", report[i]);
+    }
+    n += snprintf(out + n, sizeof(out) - n, "\n");
+    outLength = n;
+    step++;
+    return true;
+  }
+
+  default:
+    return false;
+  }
+}
+
+/**
+ * Prints the next non-empty bin of h for a job whose bins start at step
+ * first, returns false after the last one.
+ */
+bool Console::histogramLine(const Histogram &h, const char *unit,
+                            uint8_t first) {
+  uint8_t bin = step - first;
+  while (bin < HISTOGRAM_BINS && h.bins[bin] == 0) {
+    bin++;
+  }
+  if (bin >= HISTOGRAM_BINS) {
+    return false;
+  }
+  reply("  >= %7lu %s: %lu", Histogram::lowerBound(bin), unit, h.bins[bin]);
+  step = bin + first + 1;
+  return true;
+}
+
+void Console::reply(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(out, sizeof(out) - 1, fmt, args);
+  va_end(args);
+  if (n > (int)sizeof(out) - 2) {
+    n = sizeof(out) - 2;
+  }
+  out[n++] = '\n';
+  outLength = n;
+}
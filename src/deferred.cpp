@@ -0,0 +1,3 @@
+#include "deferred.h"
+
+Deferred deferred;
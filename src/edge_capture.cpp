@@ -0,0 +1,93 @@
+#include "edge_capture.h"
+
+#include "layout.h"
+
+EdgeCapture edgeCapture;
+
+namespace {
+
+DMAMEM EdgeRecord records[CAPTURE_RECORDS];
+
+template <uint8_t N> void onEdge() { edgeCapture.edge(N); }
+
+void (*const EDGE_HANDLERS[])() = {onEdge<0>, onEdge<1>, onEdge<2>,
+                                   onEdge<3>, onEdge<4>, onEdge<5>,
+                                   onEdge<6>, onEdge<7>};
+
+static_assert(sizeof(EDGE_HANDLERS) / sizeof(EDGE_HANDLERS[0]) ==
+                  CAPTURE_MAX_PINS,
+              "one handler per capture pin");
+
+} // namespace
+
+/**
+ * Starts a fresh capture on the given slots. Only push buttons and toggles
+ * on direct pins have a pin of their own, other slots are skipped. Returns
+ * the number of pins that are being captured.
+ */
+uint8_t EdgeCapture::start(const uint8_t *slots, uint8_t count) {
+  stop();
+  armed = 0;
+  used = 0;
+  overflows = 0;
+  for (uint8_t k = 0; k < count && armed < CAPTURE_MAX_PINS; k++) {
+    if (slots[k] >= layout.count()) {
+      continue;
+    }
+    const LayoutEntry &e = layout.entry(slots[k]);
+    if ((e.kind != KIND_PUSH && e.kind != KIND_TOGGLE) ||
+        e.pin >= CORE_NUM_DIGITAL) {
+      continue;
+    }
+    pins[armed] = Pin{portInputRegister(e.pin), digitalPinToBitMask(e.pin),
+                      e.pin, slots[k]};
+    attachInterrupt(e.pin, EDGE_HANDLERS[armed], CHANGE);
+    armed++;
+  }
+  active = armed != 0;
+  return armed;
+}
+
+void EdgeCapture::stop() {
+  if (!active) {
+    return;
+  }
+  for (uint8_t n = 0; n < armed; n++) {
+    detachInterrupt(pins[n].pin);
+  }
+  active = false;
+}
+
+/**
+ * Pin change handler: the cycle counter is read first so the stamp does not
+ * include the time it takes to get here from the previous edge.
+ */
+void EdgeCapture::edge(uint8_t n) {
+  uint32_t cycles = ARM_DWT_CYCCNT;
+  const Pin &p = pins[n];
+  uint16_t i = used;
+  if (i >= CAPTURE_RECORDS) {
+    overflows++;
+    return;
+  }
+  records[i] = EdgeRecord{cycles, p.slot, uint8_t((*p.port & p.mask) != 0), 0};
+  used = i + 1;
+}
+
+const EdgeRecord &EdgeCapture::record(uint16_t i) const { return records[i]; }
+
+/**
+ * Debounce class of an input for the analyser. Encoder clicks are the push
+ * buttons right after their encoder, which is how the layout is built.
+ */
+const char *EdgeCapture::className(uint8_t slot) {
+  const LayoutEntry &e = layout.entry(slot);
+  switch (e.kind) {
+  case KIND_TOGGLE: return "toggle";
+  case KIND_MATRIX: return "matrix";
+  case KIND_PUSH:
+    return slot > 0 && layout.entry(slot - 1).kind == KIND_ENCODER ? "click"
+                                                                    : "push";
+  default: return "other";
+  }
+}
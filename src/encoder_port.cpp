@@ -0,0 +1,109 @@
+#include "encoder_port.h"
+
+#include "layout.h"
+#include "scanner.h"
+
+EncoderPort encoderPort;
+
+namespace {
+
+template <uint8_t N> void onEdge() { encoderPort.edge(N); }
+
+void (*const EDGE_HANDLERS[])() = {onEdge<0>, onEdge<1>, onEdge<2>,
+                                   onEdge<3>, onEdge<4>, onEdge<5>,
+                                   onEdge<6>, onEdge<7>};
+
+} // namespace
+
+/**
+ * Encoder pins are taken from the active layout at boot. Buttons, pulse
+ * width and flags follow layout swaps; moving an encoder to other pins needs
+ * a reboot.
+ */
+void EncoderPort::begin() {
+  pulseTrains.begin(joystickSink, pipeline);
+  const LayoutBlob &blob = layout.active().blob;
+  for (uint8_t i = 0; i < blob.header.count && count < MAX_ROTARY_ENCODERS;
+       i++) {
+    const LayoutEntry &e = blob.entries[i];
+    if (e.kind != KIND_ENCODER || e.pin >= CORE_NUM_DIGITAL ||
+        e.pin2 >= CORE_NUM_DIGITAL || Scanner::busPin(e.pin) ||
+        Scanner::busPin(e.pin2)) {
+      continue;
+    }
+    Channel &c = channels[count];
+    pinMode(e.pin, INPUT_PULLUP);
+    pinMode(e.pin2, INPUT_PULLUP);
+    c.portA = portInputRegister(e.pin);
+    c.portB = portInputRegister(e.pin2);
+    c.maskA = digitalPinToBitMask(e.pin);
+    c.maskB = digitalPinToBitMask(e.pin2);
+    c.slot = i;
+    c.decoder = QuadratureDecoder();
+    c.filter = DetentFilter();
+    c.pending = 0;
+    c.fast = 0;
+    pulseTrains.attach(count, i);
+
+    attachInterrupt(e.pin, EDGE_HANDLERS[count], CHANGE);
+    attachInterrupt(e.pin2, EDGE_HANDLERS[count], CHANGE);
+    count++;
+  }
+}
+
+/**
+ * Pin change handler, constant time per transition: a table lookup for the
+ * direction and, on a detent, the rejection checks plus a clz and a table
+ * lookup for the steps.
+ */
+void EncoderPort::edge(uint8_t n) {
+  Channel &c = channels[n];
+  uint8_t levels = ((*c.portA & c.maskA) ? 1 : 0) | ((*c.portB & c.maskB) ? 2 : 0);
+  // both pins of a pair can fire for one change, the second sees no change
+  if (levels == c.decoder.ab) {
+    return;
+  }
+  uint32_t now = micros();
+  intervals.add(c.filter.transition(now));
+
+  uint8_t flags = layout.entry(c.slot).flags;
+  int8_t dir = c.decoder.update(levels, flags & FLAG_QUAD_PRECISION);
+  if (dir == 0 || !c.filter.accept(dir, now)) {
+    return;
+  }
+
+  bool reversed = dir != c.filter.lastDir;
+  uint32_t interval = c.filter.detent(dir, now);
+  uint8_t steps = 1;
+  // a reversal starts slow again whatever the interval says
+  if ((flags & FLAG_ACCEL) && !reversed) {
+    steps = accelSteps(interval);
+  }
+  // with fast buttons a multiplied detent is one pulse of those instead
+  if (steps > 1 && layout.fastSlot(c.slot) != LAYOUT_NO_PIN) {
+    c.fast += dir;
+  } else {
+    c.pending += dir * steps;
+  }
+  detents++;
+}
+
+/**
+ * Takes the steps the interrupt collected and feeds them to the pulse
+ * trains.
+ */
+void EncoderPort::poll() {
+  for (uint8_t n = 0; n < count; n++) {
+    noInterrupts();
+    int16_t s = channels[n].pending;
+    int16_t f = channels[n].fast;
+    channels[n].pending = 0;
+    channels[n].fast = 0;
+    interrupts();
+    if (s == 0 && f == 0) {
+      continue;
+    }
+    steps += (s > 0 ? s : -s) + (f > 0 ? f : -f);
+    pulseTrains.step(n, s, f);
+  }
+}
@@ -0,0 +1,99 @@
+#include "expander_port.h"
+
+ExpanderPort expanderPort;
+
+#if MCP23017_CHIPS > 0
+
+#include <Wire.h>
+
+// LPI2C master command words, the data byte goes in the low 8 bits
+#define LPI2C_CMD_RECEIVE (1 << 8) // receive data + 1 bytes
+#define LPI2C_CMD_STOP (2 << 8)
+#define LPI2C_CMD_START (4 << 8) // START, then send data as the address
+
+#define LPI2C_MSR_ERRORS                                                       \
+  (LPI2C_MSR_NDF | LPI2C_MSR_ALF | LPI2C_MSR_FEF | LPI2C_MSR_PLTF)
+
+// how long begin() waits for the first burst before going on without it
+#define MCP23017_BEGIN_TIMEOUT_US 10000
+
+void Lpi2cBus::startRead(uint8_t address, uint8_t length) {
+  MCP23017_LPI2C.MTDR = LPI2C_CMD_START | (address << 1) | 1;
+  MCP23017_LPI2C.MTDR = LPI2C_CMD_RECEIVE | (length - 1);
+  MCP23017_LPI2C.MTDR = LPI2C_CMD_STOP;
+}
+
+I2cBus::Status Lpi2cBus::poll(uint8_t *data, uint8_t length) {
+  uint32_t status = MCP23017_LPI2C.MSR;
+  if (status & LPI2C_MSR_ERRORS) {
+    // throw away what is left of the transfer, the master ignores new
+    // commands until the error flags are cleared
+    MCP23017_LPI2C.MCR |= LPI2C_MCR_RTF | LPI2C_MCR_RRF;
+    MCP23017_LPI2C.MSR = status & LPI2C_MSR_ERRORS;
+    return FAILED;
+  }
+  if (((MCP23017_LPI2C.MFSR >> 16) & 0x07) < length) {
+    return BUSY;
+  }
+  for (uint8_t i = 0; i < length; i++) {
+    data[i] = MCP23017_LPI2C.MRDR;
+  }
+  return DONE;
+}
+
+void ExpanderPort::onInterrupt() {
+  expanderPort.chain.interrupt(ARM_DWT_CYCCNT);
+}
+
+void ExpanderPort::configure(uint8_t chip) {
+  const uint8_t writes[][2] = {
+      {MCP23017_IOCON, MCP23017_IOCON_MIRROR | MCP23017_IOCON_SEQOP |
+                           MCP23017_IOCON_ODR},
+      {MCP23017_IODIRA, 0xFF},   {MCP23017_IODIRA + 1, 0xFF},
+      {MCP23017_GPPUA, 0xFF},    {MCP23017_GPPUA + 1, 0xFF},
+      {MCP23017_INTCONA, 0x00},  {MCP23017_INTCONA + 1, 0x00},
+      {MCP23017_GPINTENA, 0xFF}, {MCP23017_GPINTENA + 1, 0xFF},
+  };
+  for (const auto &w : writes) {
+    MCP23017_WIRE.beginTransmission(MCP23017_ADDRESS + chip);
+    MCP23017_WIRE.write(w[0]);
+    MCP23017_WIRE.write(w[1]);
+    MCP23017_WIRE.endTransmission();
+  }
+  // park the pointer on GPIOA, from here on reads toggle between A and B
+  MCP23017_WIRE.beginTransmission(MCP23017_ADDRESS + chip);
+  MCP23017_WIRE.write(MCP23017_GPIOA);
+  MCP23017_WIRE.endTransmission();
+}
+
+/**
+ * Sets up every chip with blocking Wire calls, then reads them once so the
+ * first scan already sees their real levels.
+ */
+void ExpanderPort::begin() {
+  MCP23017_WIRE.begin();
+  MCP23017_WIRE.setClock(MCP23017_I2C_HZ);
+  chain.begin(MCP23017_CHIPS);
+  for (uint8_t c = 0; c < MCP23017_CHIPS; c++) {
+    configure(c);
+  }
+
+  elapsedMicros waited;
+  chain.interrupt(ARM_DWT_CYCCNT);
+  while (!chain.idle() && waited < MCP23017_BEGIN_TIMEOUT_US) {
+    chain.poll(ARM_DWT_CYCCNT);
+  }
+
+  pinMode(MCP23017_INT_PIN, INPUT_PULLUP);
+  attachInterrupt(MCP23017_INT_PIN, onInterrupt, FALLING);
+}
+
+// called by the scanner before it samples
+void ExpanderPort::poll() {
+  chain.poll(ARM_DWT_CYCCNT);
+  noInterrupts();
+  chain.recheck(ARM_DWT_CYCCNT, digitalReadFast(MCP23017_INT_PIN) == LOW);
+  interrupts();
+}
+
+#endif
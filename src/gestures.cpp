@@ -0,0 +1,102 @@
+#include "gestures.h"
+
+#include "deferred.h"
+
+GestureEngine gestures;
+
+uint8_t GestureEngine::button(uint8_t slot, Gesture g) const {
+  uint8_t base = layout.entry(slot).button2;
+  return base == LAYOUT_NO_BUTTON ? LAYOUT_NO_BUTTON : pipeline->map(base + g);
+}
+
+/**
+ * Called by the pipeline for every debounced change of an input with
+ * FLAG_GESTURES, in scan context, so presses go out with the scan's report.
+ */
+void GestureEngine::input(uint8_t slot, bool pressed) {
+  State &s = states[slot];
+  uint16_t now = deferred.now();
+  s.generation++;
+
+  if (pressed) {
+    if ((s.flags & TAPPED) && uint16_t(now - s.releasedAt) <= doubleMs) {
+      pulse(slot, GESTURE_DOUBLE);
+      s.flags &= ~TAPPED;
+    }
+    s.flags |= HELD;
+    s.pressedAt = now;
+    deferred.schedule(holdMs, onHold, (s.generation << 8) | slot);
+    return;
+  }
+
+  if (!(s.flags & HELD)) {
+    return; // its press went before end(), it is no gesture
+  }
+  uint16_t held = now - s.pressedAt;
+  if (s.flags & HOLDING) {
+    uint8_t b = button(slot, GESTURE_HOLD);
+    if (b != LAYOUT_NO_BUTTON) {
+      sink->button(b, false);
+    }
+  }
+  if (held >= longMs) {
+    pulse(slot, GESTURE_LONG);
+  }
+  // only a short press counts as the first half of a double tap
+  s.flags = held < holdMs ? TAPPED : 0;
+  s.releasedAt = now;
+}
+
+/**
+ * Lets go of every hold before the layout is swapped or the layer changes,
+ * pending timers go stale with the generation bump.
+ */
+void GestureEngine::end() {
+  for (uint8_t slot = 0; slot < LAYOUT_MAX_ENTRIES; slot++) {
+    State &s = states[slot];
+    if (s.flags & HOLDING) {
+      uint8_t b = button(slot, GESTURE_HOLD);
+      if (b != LAYOUT_NO_BUTTON) {
+        sink->button(b, false);
+      }
+    }
+    s.flags = 0;
+    s.generation++;
+  }
+}
+
+void GestureEngine::onHold(uint16_t arg) {
+  GestureEngine &g = gestures;
+  uint8_t slot = arg & 0xFF;
+  State &s = g.states[slot];
+  if (s.generation != arg >> 8 || !(s.flags & HELD)) {
+    return;
+  }
+  s.flags |= HOLDING;
+  uint8_t b = g.button(slot, GESTURE_HOLD);
+  if (b != LAYOUT_NO_BUTTON) {
+    g.emitted++;
+    g.sink->button(b, true);
+    g.sink->flush();
+  }
+}
+
+void GestureEngine::pulse(uint8_t slot, Gesture gesture) {
+  uint8_t b = button(slot, gesture);
+  if (b == LAYOUT_NO_BUTTON) {
+    return;
+  }
+  // without a timer for the release the pulse is dropped: a press and a
+  // release in the same report never reach the host
+  if (!deferred.schedule(layout.pulseMs(), onPulseEnd, b)) {
+    dropped++;
+    return;
+  }
+  emitted++;
+  sink->button(b, true);
+}
+
+void GestureEngine::onPulseEnd(uint16_t button) {
+  gestures.sink->button(button, false);
+  gestures.sink->flush();
+}
@@ -0,0 +1,175 @@
+#include "layout.h"
+
+#include <string.h>
+
+Layout layout;
+
+namespace {
+
+struct CrcTable {
+  uint32_t v[256];
+  constexpr CrcTable() : v() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+      }
+      v[i] = c;
+    }
+  }
+};
+
+constexpr CrcTable CRC_TABLE;
+
+uint32_t crc32(uint32_t crc, const uint8_t *p, size_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc = CRC_TABLE.v[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+} // namespace
+
+uint32_t layoutCrc(const LayoutBlob &blob) {
+  uint32_t crc = crc32(0, (const uint8_t *)&blob.header,
+                       offsetof(LayoutHeader, crc));
+  return crc32(crc, (const uint8_t *)blob.entries,
+               blob.header.count * sizeof(LayoutEntry));
+}
+
+size_t layoutSize(const LayoutBlob &blob) {
+  return sizeof(LayoutHeader) + blob.header.count * sizeof(LayoutEntry);
+}
+
+void Layout::clearStaging() {
+  LayoutBlob &b = staging();
+  memset(&b, 0, sizeof(b));
+  b.header.magic = LAYOUT_MAGIC;
+  b.header.version = LAYOUT_VERSION;
+}
+
+uint8_t Layout::add(const LayoutEntry &e) {
+  LayoutBlob &b = staging();
+  if (b.header.count >= LAYOUT_MAX_ENTRIES) {
+    return LAYOUT_MAX_ENTRIES;
+  }
+  b.entries[b.header.count] = e;
+  return b.header.count++;
+}
+
+void Layout::seal(uint16_t pulseMs) {
+  LayoutBlob &b = staging();
+  b.header.pulseMs = pulseMs;
+  b.header.crc = layoutCrc(b);
+}
+
+/**
+ * Validates the staging blob and derives its masks. On success the blob is
+ * marked pending and will be swapped in by the next commit(); on failure
+ * nothing is, not even a blob staged before this one.
+ */
+bool Layout::stage() {
+  LayoutTable &t = tables[current ^ 1];
+  const LayoutHeader &h = t.blob.header;
+  isPending = false;
+  if (h.magic != LAYOUT_MAGIC || h.version != LAYOUT_VERSION ||
+      h.count > LAYOUT_MAX_ENTRIES || h.crc != layoutCrc(t.blob)) {
+    return false;
+  }
+
+  memset(t.inputMask, 0, sizeof(t.inputMask));
+  memset(t.activeHigh, 0, sizeof(t.activeHigh));
+  memset(t.gestureMask, 0, sizeof(t.gestureMask));
+  memset(t.macroMask, 0, sizeof(t.macroMask));
+  memset(t.profileMask, 0, sizeof(t.profileMask));
+  memset(t.eagerMask, 0, sizeof(t.eagerMask));
+  memset(t.selectorMask, 0, sizeof(t.selectorMask));
+  memset(t.fast, LAYOUT_NO_PIN, sizeof(t.fast));
+  t.selectors = 0;
+  t.centres = 0;
+  for (uint8_t i = 0; i < h.count; i++) {
+    const LayoutEntry &e = t.blob.entries[i];
+    if (e.kind >= KIND_COUNT || e.debounce >= LAYOUT_PROFILES) {
+      return false;
+    }
+    uint64_t bit = 1ULL << (i & 63);
+    if (e.kind == KIND_PUSH || e.kind == KIND_TOGGLE || e.kind == KIND_MATRIX ||
+        e.kind == KIND_EXPANDER || e.kind == KIND_SHIFT) {
+      t.inputMask[i >> 6] |= bit;
+    }
+    if (e.flags & FLAG_INVERT) {
+      t.activeHigh[i >> 6] |= bit;
+    }
+    if (e.flags & FLAG_GESTURES) {
+      // hold, double tap and long press all need an id in every layer
+      if (e.button2 != LAYOUT_NO_BUTTON &&
+          !(layerFits(e.button2) && layerFits(e.button2 + 1) &&
+            layerFits(e.button2 + 2))) {
+        return false;
+      }
+      t.gestureMask[i >> 6] |= bit & t.inputMask[i >> 6];
+    }
+    if (e.flags & FLAG_MACRO) {
+      if (!macroCheck || !macroCheck(e.button2)) {
+        return false;
+      }
+      t.macroMask[i >> 6] |= bit & t.inputMask[i >> 6];
+    }
+    // centres are not in the input mask but are debounced all the same
+    t.profileMask[e.debounce][i >> 6] |= bit;
+    if (h.debounce[e.debounce].flags & DEBOUNCE_EAGER) {
+      t.eagerMask[i >> 6] |= bit;
+    }
+    if (e.kind == KIND_CENTRE) {
+      // the poles must be real inputs, a centre of a centre is not
+      if (e.pin >= h.count || (e.pin2 != LAYOUT_NO_PIN && e.pin2 >= h.count) ||
+          t.centres == LAYOUT_MAX_CENTRES) {
+        return false;
+      }
+      t.centre[t.centres++] = i;
+    }
+    if (e.kind == KIND_FAST) {
+      // one set of fast buttons per encoder
+      if (e.pin >= h.count || t.blob.entries[e.pin].kind != KIND_ENCODER ||
+          t.fast[e.pin] != LAYOUT_NO_PIN) {
+        return false;
+      }
+      t.fast[e.pin] = i;
+    }
+    if ((e.flags & FLAG_LAYER_SELECT) && (t.inputMask[i >> 6] & bit) &&
+        t.selectors < LAYER_MAX_SELECTORS) {
+      t.selector[t.selectors++] = i;
+      t.selectorMask[i >> 6] |= bit;
+    } else if (!layerFits(e.button) ||
+               ((e.kind == KIND_ENCODER || e.kind == KIND_FAST) &&
+                !layerFits(e.button2))) {
+      // would come out as nothing in some layer
+      return false;
+    }
+  }
+  for (uint8_t k = 0; k < t.centres; k++) {
+    const LayoutEntry &e = t.blob.entries[t.centre[k]];
+    if (!(t.inputMask[e.pin >> 6] >> (e.pin & 63) & 1) ||
+        (e.pin2 != LAYOUT_NO_PIN &&
+         !(t.inputMask[e.pin2 >> 6] >> (e.pin2 & 63) & 1))) {
+      return false;
+    }
+  }
+  // unused entries must read as released whatever a stale blob says
+  memset(&t.blob.entries[h.count], 0,
+         (LAYOUT_MAX_ENTRIES - h.count) * sizeof(LayoutEntry));
+
+  isPending = true;
+  return true;
+}
+
+bool Layout::commit() {
+  if (!isPending) {
+    return false;
+  }
+  current ^= 1;
+  gen++;
+  isPending = false;
+  return true;
+}
@@ -0,0 +1,108 @@
+#include "layout_store.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <string.h>
+
+// the EEPROM on the Teensy 4 is emulated in flash with wear levelling, a
+// write can stall for a sector erase so only a few bytes go per loop
+#define LAYOUT_STORE_BYTES_PER_POLL 4
+
+namespace {
+
+LayoutBlob pendingStore;
+uint16_t storeOffset = 0;
+uint16_t storeLength = 0;
+
+} // namespace
+
+/**
+ * Loads the layout saved in EEPROM and makes it active. Only the header and
+ * the used entries are read so a stored map costs no more boot time than it
+ * has to; the USB enumeration is running in the meantime anyway.
+ */
+bool loadStoredLayout() {
+  LayoutBlob &blob = layout.staging();
+  EEPROM.get(LAYOUT_EEPROM_ADDRESS, blob.header);
+  if (blob.header.magic != LAYOUT_MAGIC ||
+      blob.header.count > LAYOUT_MAX_ENTRIES) {
+    return false;
+  }
+  uint8_t *entries = (uint8_t *)blob.entries;
+  for (size_t i = 0; i < blob.header.count * sizeof(LayoutEntry); i++) {
+    entries[i] = EEPROM.read(LAYOUT_EEPROM_ADDRESS + sizeof(LayoutHeader) + i);
+  }
+  return layout.stage() && layout.commit();
+}
+
+void storeLayout(const LayoutBlob &blob) {
+  memcpy(&pendingStore, &blob, layoutSize(blob));
+  storeOffset = 0;
+  storeLength = layoutSize(blob);
+}
+
+void pollLayoutStore() {
+  const uint8_t *bytes = (const uint8_t *)&pendingStore;
+  for (uint8_t i = 0;
+       i < LAYOUT_STORE_BYTES_PER_POLL && storeOffset < storeLength; i++) {
+    EEPROM.update(LAYOUT_EEPROM_ADDRESS + storeOffset, bytes[storeOffset]);
+    storeOffset++;
+  }
+}
+
+/**
+ * Starts a change to the layout: staging gets a copy of the active one, which
+ * the caller edits and hands back to finishLayoutEdit() to be swapped in. A
+ * layout that was received but not swapped in yet is edited where it is, so
+ * the change lands on top of it instead of throwing it away.
+ */
+LayoutBlob &beginLayoutEdit() {
+  LayoutBlob &blob = layout.staging();
+  if (!layout.pending()) {
+    memcpy(&blob, &layout.active().blob, sizeof(blob));
+  }
+  return blob;
+}
+
+bool finishLayoutEdit() {
+  LayoutBlob &blob = layout.staging();
+  layout.seal(blob.header.pulseMs);
+  if (!layout.stage()) {
+    return false;
+  }
+  storeLayout(blob);
+  return true;
+}
+
+LayoutReceiver::Result LayoutReceiver::feed(uint8_t b, uint32_t nowMs) {
+  if (active && nowMs - lastByteMs > LAYOUT_FRAME_TIMEOUT_MS) {
+    active = false;
+  }
+  lastByteMs = nowMs;
+  if (!active) {
+    active = b == LAYOUT_FRAME_START;
+    length = 0;
+    return MORE;
+  }
+
+  ((uint8_t *)&blob)[length++] = b;
+  if (length < sizeof(LayoutHeader)) {
+    return MORE;
+  }
+  if (blob.header.magic != LAYOUT_MAGIC ||
+      blob.header.count > LAYOUT_MAX_ENTRIES) {
+    active = false;
+    return FAILED;
+  }
+  if (length < layoutSize(blob)) {
+    return MORE;
+  }
+
+  active = false;
+  memcpy(&layout.staging(), &blob, length);
+  if (!layout.stage()) {
+    return FAILED;
+  }
+  storeLayout(blob);
+  return DONE;
+}
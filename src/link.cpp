@@ -0,0 +1,146 @@
+#include "link.h"
+
+#include <string.h>
+
+namespace {
+
+struct Crc16Table {
+  uint16_t v[256];
+  constexpr Crc16Table() : v() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint16_t c = i << 8;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 0x8000) ? (c << 1) ^ 0x1021 : c << 1;
+      }
+      v[i] = c;
+    }
+  }
+};
+
+constexpr Crc16Table CRC16_TABLE;
+
+} // namespace
+
+uint16_t linkCrc(const uint8_t *data, size_t length) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc = (crc << 8) ^ CRC16_TABLE.v[(crc >> 8) ^ data[i]];
+  }
+  return crc;
+}
+
+uint8_t LinkEncoder::encode(const uint64_t *state, uint8_t *out, bool full) {
+  uint8_t *payload = out + LINK_HEADER_BYTES;
+  uint8_t length = 0;
+  full |= !started;
+  if (!full) {
+    for (uint8_t w = 0; w < LINK_WORDS && !full; w++) {
+      uint64_t flipped = state[w] ^ sent[w];
+      while (flipped) {
+        if (length == LINK_MAX_DELTA) {
+          full = true;
+          break;
+        }
+        payload[length++] = (w << 6) | __builtin_ctzll(flipped);
+        flipped &= flipped - 1;
+      }
+    }
+    if (!full && length == 0) {
+      return 0;
+    }
+  }
+  if (full) {
+    // little endian words, the same bytes on both ends
+    memcpy(payload, state, LINK_MAX_PAYLOAD);
+    length = LINK_MAX_PAYLOAD;
+    fullFrames++;
+  }
+  memcpy(sent, state, sizeof(sent));
+  started = true;
+
+  out[0] = LINK_SYNC;
+  out[1] = seq++;
+  out[2] = full ? LINK_FULL : LINK_DELTA;
+  out[3] = length;
+  uint16_t crc = linkCrc(out + 1, LINK_HEADER_BYTES - 1 + length);
+  payload[length] = crc & 0xFF;
+  payload[length + 1] = crc >> 8;
+  frames++;
+  return LINK_HEADER_BYTES + length + LINK_CRC_BYTES;
+}
+
+void LinkDecoder::reset() {
+  length = 0;
+  inSync = false;
+  memset(current, 0, sizeof(current));
+}
+
+bool LinkDecoder::feed(uint8_t byte) {
+  if (length == 0 && byte != LINK_SYNC) {
+    junk++;
+    return false;
+  }
+  frame[length++] = byte;
+  if (length == LINK_HEADER_BYTES &&
+      (frame[2] == LINK_FULL ? frame[3] != LINK_MAX_PAYLOAD
+                             : frame[2] != LINK_DELTA ||
+                                   frame[3] > LINK_MAX_DELTA)) {
+    // cannot be a header, hunt for the next sync byte
+    junk += length;
+    length = 0;
+    return false;
+  }
+  if (length < LINK_HEADER_BYTES ||
+      length < LINK_HEADER_BYTES + frame[3] + LINK_CRC_BYTES) {
+    return false;
+  }
+
+  uint8_t payload = frame[3];
+  length = 0;
+  uint16_t crc = frame[LINK_HEADER_BYTES + payload] |
+                 frame[LINK_HEADER_BYTES + payload + 1] << 8;
+  if (crc != linkCrc(frame + 1, LINK_HEADER_BYTES - 1 + payload)) {
+    crcErrors++;
+    return false;
+  }
+  frames++;
+  return apply();
+}
+
+bool LinkDecoder::apply() {
+  uint8_t seq = frame[1];
+  const uint8_t *payload = frame + LINK_HEADER_BYTES;
+  uint64_t before[LINK_WORDS];
+  memcpy(before, current, sizeof(before));
+
+  if (frame[2] == LINK_FULL) {
+    memcpy(current, payload, sizeof(current));
+    inSync = true;
+  } else if (frame[2] == LINK_DELTA && inSync &&
+             seq == uint8_t(lastSeq + 1)) {
+    for (uint8_t i = 0; i < frame[3]; i++) {
+      uint8_t slot = payload[i];
+      if (slot < LINK_SLOTS) {
+        current[slot >> 6] ^= 1ULL << (slot & 63);
+      }
+    }
+  } else {
+    // a delta on top of a frame we never saw, wait for the next full one
+    gaps++;
+    inSync = false;
+  }
+  lastSeq = seq;
+  return memcmp(before, current, sizeof(before)) != 0;
+}
+
+void linkMerge(const uint64_t *before, const uint64_t *after, uint8_t first,
+               ButtonSink &sink) {
+  for (uint8_t w = 0; w < LINK_WORDS; w++) {
+    uint64_t flipped = before[w] ^ after[w];
+    while (flipped) {
+      uint8_t bit = __builtin_ctzll(flipped);
+      flipped &= flipped - 1;
+      sink.button(first + (w << 6) + bit, (after[w] >> bit) & 1);
+    }
+  }
+}
@@ -0,0 +1,72 @@
+#include "link_port.h"
+
+#include <string.h>
+
+#include "scanner.h"
+
+LinkPort linkPort;
+
+#if LINK_MODE == 2
+
+void LinkPort::begin() {
+  LINK_SERIAL.begin(LINK_BAUD);
+  LINK_SERIAL.addMemoryForRead(buffer, sizeof(buffer));
+}
+
+void LinkPort::poll() {
+  uint32_t start = micros();
+  uint32_t frames = rx.frames;
+  bool changed = false;
+  while (LINK_SERIAL.available() > 0) {
+    if (rx.feed(LINK_SERIAL.read())) {
+      linkMerge(merged, rx.state(), LINK_FIRST_BUTTON, joystickSink);
+      memcpy(merged, rx.state(), sizeof(merged));
+      changed = true;
+    }
+  }
+
+  uint32_t now = millis();
+  if (rx.frames != frames) {
+    lastFrameMs = now;
+  } else if (now - lastFrameMs > LINK_TIMEOUT_MS && rx.synced()) {
+    // the slave is gone, nothing of it may stay pressed
+    const uint64_t released[LINK_WORDS] = {};
+    linkMerge(merged, released, LINK_FIRST_BUTTON, joystickSink);
+    memset(merged, 0, sizeof(merged));
+    rx.reset();
+    timeouts++;
+    changed = true;
+  }
+
+  if (changed) {
+    joystickSink.flush();
+    frameUs.add(micros() - start);
+  }
+}
+
+#elif LINK_MODE == 1
+
+void LinkPort::begin() {
+  LINK_SERIAL.begin(LINK_BAUD);
+  LINK_SERIAL.addMemoryForWrite(buffer, sizeof(buffer));
+}
+
+void LinkPort::poll() {
+  // a frame that does not fit waits, the next one carries its changes too
+  if (LINK_SERIAL.availableForWrite() < LINK_MAX_FRAME) {
+    stalls++;
+    return;
+  }
+  uint32_t now = millis();
+  bool full = now - lastFullMs >= LINK_KEYFRAME_MS;
+  uint8_t frame[LINK_MAX_FRAME];
+  uint8_t length = tx.encode(image, frame, full);
+  if (full) {
+    lastFullMs = now;
+  }
+  if (length) {
+    LINK_SERIAL.write(frame, length);
+  }
+}
+
+#endif
@@ -0,0 +1,144 @@
+#include "macros.h"
+
+#include "deferred.h"
+
+MacroSequencer macros;
+
+namespace {
+
+MacroStep stepAt(const MacroStep *p) {
+  MacroStep s;
+  memcpy_P(&s, p, sizeof(s));
+  return s;
+}
+
+} // namespace
+
+void MacroSequencer::define(const Macro *table, uint8_t count) {
+  this->table = table;
+  macroCount = count;
+}
+
+void MacroSequencer::begin(ButtonSink &sink, MacroClock clock) {
+  this->sink = &sink;
+  this->clock = clock;
+}
+
+/**
+ * True when the macro exists and every step of it presses a button the
+ * report has, the check a layout has to pass to start it.
+ */
+bool MacroSequencer::valid(uint8_t macro) const {
+  if (macro >= macroCount) {
+    return false;
+  }
+  Macro m;
+  memcpy_P(&m, table + macro, sizeof(m));
+  for (uint8_t i = 0; i < m.length; i++) {
+    MacroStep s = stepAt(m.steps + i);
+    if (s.button < 1 || s.button > LAYER_MAX_BUTTON) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Runs the steps of a macro up to its first wait right away, in the caller's
+ * report. Returns false when there is no such macro or no free runner.
+ */
+bool MacroSequencer::start(uint8_t macro) {
+  if (macro >= macroCount) {
+    return false;
+  }
+  Macro m;
+  memcpy_P(&m, table + macro, sizeof(m));
+  if (m.length == 0) {
+    return false;
+  }
+  for (uint8_t r = 0; r < MACRO_MAX_RUNNING; r++) {
+    Runner &run = runners[r];
+    if (run.left) {
+      continue;
+    }
+    run.first = run.next = m.steps;
+    run.left = m.length;
+    run.dueUs = clock();
+    started++;
+    this->run(r);
+    return true;
+  }
+  dropped++;
+  return false;
+}
+
+/**
+ * Stops every macro and lets go of whatever it pressed, used before the
+ * layout is swapped.
+ */
+void MacroSequencer::end() {
+  for (uint8_t r = 0; r < MACRO_MAX_RUNNING; r++) {
+    stop(r);
+  }
+}
+
+// pending steps of the runner go stale with the generation bump
+void MacroSequencer::stop(uint8_t r) {
+  Runner &run = runners[r];
+  if (!run.left) {
+    return;
+  }
+  for (const MacroStep *p = run.first; p != run.next; p++) {
+    MacroStep s = stepAt(p);
+    if (s.pressed) {
+      sink->button(s.button, false);
+    }
+  }
+  run.left = 0;
+  run.generation++;
+}
+
+uint8_t MacroSequencer::running() const {
+  uint8_t n = 0;
+  for (const Runner &run : runners) {
+    n += run.left != 0;
+  }
+  return n;
+}
+
+void MacroSequencer::run(uint8_t r) {
+  Runner &run = runners[r];
+  uint32_t wait = 0;
+  while (run.left && wait == 0) {
+    MacroStep s = stepAt(run.next++);
+    run.left--;
+    sink->button(s.button, s.pressed);
+    wait = s.waitMs;
+  }
+  if (!run.left) {
+    return;
+  }
+
+  // plan from the step's due time, not from now, so a late step does not
+  // push back the rest of the macro
+  int32_t late = int32_t(clock() - run.dueUs) / 1000;
+  run.dueUs += wait * 1000UL;
+  uint32_t delay = late <= 0 ? wait : uint32_t(late) < wait ? wait - late : 0;
+  if (!deferred.schedule(delay, onStep, (run.generation << 8) | r)) {
+    // no timer left, the macro ends here with its buttons let go
+    stop(r);
+  }
+}
+
+void MacroSequencer::onStep(uint16_t arg) {
+  MacroSequencer &m = macros;
+  uint8_t r = arg & 0xFF;
+  Runner &run = m.runners[r];
+  if (run.generation != arg >> 8 || !run.left) {
+    return;
+  }
+  int32_t error = m.clock() - run.dueUs;
+  m.error.add(error < 0 ? -error : error);
+  m.run(r);
+  m.sink->flush();
+}
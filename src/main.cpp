@@ -1,31 +1,59 @@
 /**
- * This example shows how to use the matrix keyboard support that's built into
- * IoAbstraction, it can be used out the box with either a 3x4 or 4x4 keypad,
- * but you can modify it to use any matrix keyboard quite easily. It just sends
- * the characters that are typed on the keyboard to Serial. The keyboard in This
- * example is connected directly to Arduino pins, but could just as easily be
- * connected over a PCF8574, MCP23017 or other IoAbstraction. For interrupt
- * mode, you cannot use a PCF8574 because the interrupt on the device would be
- * triggered by the output changes when scanning. Only MCP23017 and device pins
- * can be used in interrupt mode.
+ * Firmware for the Mobeartec button box: toggle switches, push buttons, a 3x5
+ * key matrix and seven rotary encoders on a Teensy 4.1, reported to the host
+ * as a single USB joystick.
+ *
+ * The BUTTON_x_y definitions below are the default layout. At boot the layout
+ * stored in EEPROM wins if it is valid, and a new one can be pushed over
+ * serial at any time (see layout_store.h) without reflashing. Type help on
+ * the serial port for the tuning console.
  *
  * Documentation and reference:
  *
  * https://www.thecoderscorner.com/products/arduino-downloads/io-abstraction/
  * https://www.thecoderscorner.com/ref-docs/ioabstraction/html/index.html
  */
-// This optional setting causes Encoder to use more optimized code,
-// It must be defined before Encoder.h is included.
-#define ENCODER_OPTIMIZE_INTERRUPTS
-
 #include <Arduino.h>
-#include <EncoderButton.h>
-#include <IoAbstraction.h>
-#include <IoAbstractionWire.h>
 #include <IoLogging.h>
-#include <KeyboardManager.h>
 #include <TaskManagerIO.h>
 
+#include "analog_port.h"
+#include "chords.h"
+#include "console.h"
+#include "debounce_profiles.h"
+#include "deferred.h"
+#include "encoder_port.h"
+#include "layout.h"
+#include "layout_store.h"
+#include "link_port.h"
+#include "macros.h"
+#include "profiler.h"
+#include "scanner.h"
+#include "telemetry_port.h"
+#include "usb_resync.h"
+
+// with report ids the encoder detents live in their own report section, so
+// spinning a knob does not resend the switch bits
+#if defined(BUTTONBOX_REPORT_IDS)
+#define ENCODER_BUTTON_OFFSET 64
+#else
+#define ENCODER_BUTTON_OFFSET 0
+#endif
+
+// centre positions of the double toggles need ids past the 56 of the plain
+// report, without them the host still reads the centre from both poles up
+#if LAYER_MAX_BUTTON > 56
+#define CENTRE_BUTTON(id) (id)
+#else
+#define CENTRE_BUTTON(id) -1
+#endif
+
+// highest id the layout below uses, every layer has to hold all of them
+#define DEFAULT_MAX_BUTTON (LAYER_MAX_BUTTON > 56 ? 61 : 55)
+static_assert(LAYER_COUNT == 1 || layerFits(DEFAULT_MAX_BUTTON),
+              "the default layout needs more ids than a layer holds, renumber "
+              "it or use fewer layers");
+
 struct ToggleSwitch {
   int button;
   int pin;
@@ -36,11 +64,14 @@ struct ToggleSwitchDouble {
   int buttonDown;
   int pinUp;
   int pinDown;
+  int buttonCentre = -1; // down while neither pole is
 };
 
 struct PushButton {
   int button;
   int pin;
+  int gestures = -1; // first of the hold, double tap and long press buttons
+  int macro = -1;    // macro started on press, see MACROS
 };
 
 struct MyEncoder {
@@ -53,38 +84,42 @@ struct MyEncoder {
   int pinClick;
 
   bool useQuadPrecision;
-  EncoderListener *rotateListener;
-  EncoderButton *button;
+  bool useAcceleration;
 };
 
-MyEncoder *encoders[8];
-
 // row one: two toggle buttons + one big button
 auto BUTTON_1_1 = ToggleSwitch{.button = 1, .pin = CORE_INT11_PIN};
-auto BUTTON_1_2 = ToggleSwitch{.button = 1, .pin = -1};
-auto BUTTON_1_3 = PushButton{.button = 2, .pin = CORE_INT12_PIN};
+// the off position of BUTTON_1_1, derived from its pin
+auto BUTTON_1_2 = ToggleSwitch{.button = 55, .pin = -1};
+auto BUTTON_1_3 =
+    PushButton{.button = 2, .pin = CORE_INT12_PIN, .gestures = 48};
 
 // row two: five toggle switches
 auto BUTTON_2_1 = ToggleSwitchDouble{.buttonUp = 3,
                                      .buttonDown = 4,
                                      .pinUp = CORE_INT30_PIN,
-                                     .pinDown = CORE_INT31_PIN};
+                                     .pinDown = CORE_INT31_PIN,
+                                     .buttonCentre = CENTRE_BUTTON(57)};
 auto BUTTON_2_2 = ToggleSwitchDouble{.buttonUp = 5,
                                      .buttonDown = 6,
                                      .pinUp = CORE_INT28_PIN,
-                                     .pinDown = CORE_INT29_PIN};
+                                     .pinDown = CORE_INT29_PIN,
+                                     .buttonCentre = CENTRE_BUTTON(58)};
 auto BUTTON_2_3 = ToggleSwitchDouble{.buttonUp = 7,
                                      .buttonDown = 8,
                                      .pinUp = CORE_INT26_PIN,
-                                     .pinDown = CORE_INT27_PIN};
+                                     .pinDown = CORE_INT27_PIN,
+                                     .buttonCentre = CENTRE_BUTTON(59)};
 auto BUTTON_2_4 = ToggleSwitchDouble{.buttonUp = 9,
                                      .buttonDown = 10,
                                      .pinUp = CORE_INT24_PIN,
-                                     .pinDown = CORE_INT25_PIN};
+                                     .pinDown = CORE_INT25_PIN,
+                                     .buttonCentre = CENTRE_BUTTON(60)};
 auto BUTTON_2_5 = ToggleSwitchDouble{.buttonUp = 11,
                                      .buttonDown = 12,
                                      .pinUp = CORE_INT9_PIN,
-                                     .pinDown = CORE_INT10_PIN};
+                                     .pinDown = CORE_INT10_PIN,
+                                     .buttonCentre = CENTRE_BUTTON(61)};
 
 // row three: four rotary encoders
 auto BUTTON_3_1 = MyEncoder{.buttonLeft = 13,
@@ -127,7 +162,7 @@ auto BUTTON_6_1 = PushButton{.button = 35, .pin = -1};
 auto BUTTON_6_2 = PushButton{.button = 36, .pin = -1};
 auto BUTTON_6_3 = PushButton{.button = 37, .pin = -1};
 auto BUTTON_6_4 = PushButton{.button = 38, .pin = -1};
-auto BUTTON_6_5 = PushButton{.button = 39, .pin = -1};
+auto BUTTON_6_5 = PushButton{.button = 39, .pin = -1, .macro = 0};
 
 // row five: handle 3 rotary encoders at the bottom as one row
 
@@ -138,7 +173,8 @@ auto BUTTON_7_1 = MyEncoder{.buttonLeft = 40,
                             .pinA = CORE_INT20_PIN,
                             .pinB = CORE_INT19_PIN,
                             .pinClick = CORE_INT18_PIN,
-                            .useQuadPrecision = true};
+                            .useQuadPrecision = true,
+                            .useAcceleration = true};
 
 // smaller rotary encoders
 auto BUTTON_7_2 = MyEncoder{.buttonLeft = 42,
@@ -154,223 +190,201 @@ auto BUTTON_7_3 = MyEncoder{.buttonLeft = 45,
                             .pinB = CORE_INT13_PIN,
                             .pinClick = CORE_INT32_PIN};
 
-//
-// We need to make a keyboard layout that the manager can use. choose one of the
-// below. The parameter in brackets is the variable name.
-//
-// MAKE_KEYBOARD_LAYOUT_3X4(keyLayout)
-// MAKE_KEYBOARD_LAYOUT_4X4(keyLayout)
-const char KEYBOARD_STD_3X5_KEYS[] PROGMEM =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
-KeyboardLayout keyLayout(3, 5, KEYBOARD_STD_3X5_KEYS);
-
-// this examples connects the pins directly to an arduino but you could use
-// IoExpanders or shift registers instead.
-IoAbstractionRef arduinoIo = ioUsingArduino();
-
-//
-// We need a keyboard manager class too
-//
-MatrixKeyboardManager keyboard;
-
-// this examples connects the pins directly to an arduino but you could use
-// IoExpanders or shift registers instead.
-// MCP23017IoAbstraction io23017(0x20, ACTIVE_LOW_OPEN, 10);
-
-//
-// We need a class that extends from KeyboardListener. this gets notified when
-// there are changes in the keyboard state.
-//
-class MyKeyboardListener : public KeyboardListener {
-public:
-  void keyPressed(char key, bool held) override {
-    Serial.print("Key ");
-    Serial.print(key);
-    Serial.print(" is pressed, held = ");
-    Serial.println(held);
-
-    // lookup char position []char KEYBOARD_STD_3X5_KEYS
-    int button = 99;
-    for (int i = 0; KEYBOARD_STD_3X5_KEYS[i]; i++) {
-      if (KEYBOARD_STD_3X5_KEYS[i] == key) {
-        button = i;
-        break;
-      }
-    }
-
-    button = button + BUTTON_3_4.buttonClick + 1;
-    Serial.print("Button pressed: ");
-    Serial.println(button);
-    Joystick.button(button, HIGH);
-    digitalWrite(LED_BUILTIN, HIGH);
-  }
-
-  void keyReleased(char key) override {
-    // lookup char position []char KEYBOARD_STD_3X5_KEYS
-    int button = 99;
-    for (int i = 0; KEYBOARD_STD_3X5_KEYS[i]; i++) {
-      if (KEYBOARD_STD_3X5_KEYS[i] == key) {
-        button = i;
-        break;
-      }
-    }
+#if MCP23017_CHIPS > 0
+// the expanders sit on the Wire pins of the big encoder, which is left out,
+// and bring 16 inputs per chip as buttons from this id on
+#define EXPANDER_FIRST_BUTTON 65
+static_assert(EXPANDER_FIRST_BUTTON + MCP23017_CHIPS * 16 - 1 <=
+                  LAYER_MAX_BUTTON,
+              "the expander inputs need BUTTONBOX_EXTREME_JOYSTICK");
+// 47 entries at most without the big encoder's two
+static_assert(45 + MCP23017_CHIPS * 16 <= LAYOUT_MAX_ENTRIES,
+              "raise LAYOUT_MAX_ENTRIES to cover the expander inputs");
+#endif
+
+#if SHIFT_CHIPS > 0
+// the chain takes pins 10-13 for SPI and PL, so the switches and the small
+// encoder there are left out, and brings 8 inputs per chip as buttons from
+// this id on
+#define SHIFT_FIRST_BUTTON 65
+static_assert(SHIFT_FIRST_BUTTON + SHIFT_CHIPS * 8 - 1 <= LAYER_MAX_BUTTON,
+              "the chain inputs need BUTTONBOX_EXTREME_JOYSTICK, without "
+              "layers and with eight chips at most");
+#endif
+
+// row four to six: matrix buttons (3x5), driven by row, read by column
+const uint8_t MATRIX_ROW_PINS[] = {CORE_INT0_PIN, CORE_INT1_PIN, CORE_INT2_PIN};
+const uint8_t MATRIX_COL_PINS[] = {CORE_INT3_PIN, CORE_INT4_PIN, CORE_INT5_PIN,
+                                   CORE_INT6_PIN, CORE_INT7_PIN};
+PushButton *MATRIX_KEYS[3][5] = {
+    {&BUTTON_4_1, &BUTTON_4_2, &BUTTON_4_3, &BUTTON_4_4, &BUTTON_4_5},
+    {&BUTTON_5_1, &BUTTON_5_2, &BUTTON_5_3, &BUTTON_5_4, &BUTTON_5_5},
+    {&BUTTON_6_1, &BUTTON_6_2, &BUTTON_6_3, &BUTTON_6_4, &BUTTON_6_5}};
+
+// chords by button id, the two left keys of row four plus the click of the
+// first encoder give button 51 and only that
+const ChordDef CHORDS[] = {
+    {51, {25, 26, 15}},
+};
 
-    button = button + BUTTON_3_4.buttonClick + 1;
-    Serial.print("Button released: ");
-    Serial.println(button);
-    Joystick.button(button, LOW);
-    digitalWrite(LED_BUILTIN, LOW);
-  }
-} myKeyboardListener;
+// macros as (button, pressed, wait ms) steps, PROGMEM keeps them in flash
+const MacroStep STARTUP[] PROGMEM = {
+    {52, 1, 100}, {52, 0, 400},  // battery
+    {53, 1, 100}, {53, 0, 2000}, // apu, give it time to spool up
+    {54, 1, 100}, {54, 0, 0},    // engine
+};
+const Macro MACROS[] PROGMEM = {MACRO(STARTUP)};
 
-class EncoderRotateListener : public EncoderListener {
-public:
-  int buttonLeft;
-  int buttonRight;
+uint8_t toPin(int pin) { return pin < 0 ? LAYOUT_NO_PIN : pin; }
 
-  EncoderRotateListener(int buttonLeft, int buttonRight) : EncoderListener() {
-    this->buttonRight = buttonRight;
-    this->buttonLeft = buttonLeft;
-  }
+uint8_t toButton(int button) { return button < 0 ? LAYOUT_NO_BUTTON : button; }
 
-  void encoderHasChanged(int newValue) override {
-    Serial.print("Encoder change button ");
-    if (newValue > 0) {
-      Serial.print(this->buttonRight);
-      Serial.print(" ");
-      Serial.println("right");
-      Joystick.button(this->buttonRight, HIGH);
-      // Joystick.button(this->buttonRight, LOW);
-      int button = this->buttonRight;
-      taskManager.schedule(onceMillis(20),
-                           [button]() { Joystick.button(button, LOW); });
-
-
-    } else if (newValue < 0) {
-      Serial.print(this->buttonLeft);
-      Serial.print(" ");
-      Serial.println("left");
-      Joystick.button(this->buttonLeft, HIGH);
-      // Joystick.button(this->buttonLeft, LOW);
-      int button = this->buttonLeft;
-      taskManager.schedule(onceMillis(20),
-                           [button]() { Joystick.button(button, LOW); });
-    }
-  }
+uint8_t toEncoderButton(int button) {
+  return button < 0 ? LAYOUT_NO_BUTTON : button + ENCODER_BUTTON_OFFSET;
+}
 
-  void operator()(EncoderButton &eb) const {
-    encoderHasChanged(eb.increment());
+// a push button with gestures or a macro carries it in flags and button2
+LayoutEntry pushEntry(InputKind kind, uint8_t pin, uint8_t pin2,
+                      PushButton *b, uint8_t profile) {
+  uint8_t flags = 0;
+  uint8_t button2 = LAYOUT_NO_BUTTON;
+  if (b->macro >= 0) {
+    flags = FLAG_MACRO;
+    button2 = b->macro;
+  } else if (b->gestures >= 0) {
+    flags = FLAG_GESTURES;
+    button2 = b->gestures;
   }
-};
-
-/**
- * In this method we initialise the keyboard to use the arduino pins directly.
- * We assume a 4x3 keyboard was set at the top. We use the keyboard in polling
- * mode in this case. Polling mode can be used on any device.
- */
-void initialiseKeyboard3X5() {
-  keyLayout.setRowPin(0, CORE_INT0_PIN);
-  keyLayout.setRowPin(1, CORE_INT1_PIN);
-  keyLayout.setRowPin(2, CORE_INT2_PIN);
-  keyLayout.setColPin(0, CORE_INT3_PIN);
-  keyLayout.setColPin(1, CORE_INT4_PIN);
-  keyLayout.setColPin(2, CORE_INT5_PIN);
-  keyLayout.setColPin(3, CORE_INT6_PIN);
-  keyLayout.setColPin(4, CORE_INT7_PIN);
-
-  // create the keyboard mapped to arduino pins and with the layout chosen
-  // above. it will callback our listener
-  keyboard.initialise(arduinoIo, &keyLayout, &myKeyboardListener, false);
+  return LayoutEntry{kind,    flags,  pin, pin2, toButton(b->button),
+                     button2, profile};
 }
 
-class ClickListener : public SwitchListener {
-  int button;
+void addPushButton(PushButton *button) {
+  layout.add(pushEntry(KIND_PUSH, toPin(button->pin), LAYOUT_NO_PIN, button,
+                       PROFILE_PUSH));
+}
 
-public:
-  ClickListener(int button) : SwitchListener() { this->button = button; }
+uint8_t addToggleSwitch(ToggleSwitch *s, uint8_t flags = 0) {
+  return layout.add(LayoutEntry{KIND_TOGGLE, uint8_t(FLAG_INVERT | flags),
+                                toPin(s->pin), LAYOUT_NO_PIN,
+                                toButton(s->button), LAYOUT_NO_BUTTON,
+                                PROFILE_TOGGLE});
+}
 
-  void onPressed(pinid_t pin, bool held) override {
-    Serial.print("Button pressed: ");
-    Serial.println(this->button);
-    Joystick.button(this->button, HIGH);
-  }
-  /**
-   * called when a key is released
-   * @param pin the key number
-   * @param held true if key was held down
-   */
-  void onReleased(pinid_t pin, bool held) override {
-    Serial.print("Button released: ");
-    Serial.println(this->button);
-    Joystick.button(this->button, LOW);
+// a virtual button that is down while none of the pole slots are
+void addCentre(int button, uint8_t pole, uint8_t pole2 = LAYOUT_NO_PIN) {
+  if (button >= 0) {
+    layout.add(LayoutEntry{KIND_CENTRE, 0, pole, pole2, toButton(button),
+                           LAYOUT_NO_BUTTON, PROFILE_TOGGLE});
   }
-};
-
-void initialisePushButton(PushButton *button) {
-  switches.addSwitchListener(button->pin, new ClickListener(button->button),
-                             NO_REPEAT);
 }
 
-void initialisePushButtons() {
-  initialisePushButton(&BUTTON_1_3);
-  initialisePushButton(&BUTTON_1_3);
+void addDoubleToggleSwitch(ToggleSwitchDouble *s) {
+  uint8_t up = layout.add(LayoutEntry{KIND_TOGGLE, 0, toPin(s->pinUp),
+                                      LAYOUT_NO_PIN, toButton(s->buttonUp),
+                                      LAYOUT_NO_BUTTON, PROFILE_TOGGLE});
+  uint8_t down = layout.add(LayoutEntry{KIND_TOGGLE, 0, toPin(s->pinDown),
+                                        LAYOUT_NO_PIN, toButton(s->buttonDown),
+                                        LAYOUT_NO_BUTTON, PROFILE_TOGGLE});
+  addCentre(s->buttonCentre, up, down);
 }
 
-void initialiseToggleSwitch(ToggleSwitch *s) {
-  switches.addSwitchListener(s->pin, new ClickListener(s->button), NO_REPEAT,
-                             true);
+void addEncoder(MyEncoder *e) {
+  uint8_t flags = (e->useQuadPrecision ? FLAG_QUAD_PRECISION : 0) |
+                  (e->useAcceleration ? FLAG_ACCEL : 0);
+  layout.add(LayoutEntry{KIND_ENCODER, flags, toPin(e->pinA), toPin(e->pinB),
+                         toEncoderButton(e->buttonRight),
+                         toEncoderButton(e->buttonLeft)});
+  layout.add(LayoutEntry{KIND_PUSH, 0, toPin(e->pinClick), LAYOUT_NO_PIN,
+                         toButton(e->buttonClick), LAYOUT_NO_BUTTON,
+                         PROFILE_CLICK});
 }
 
-void initialiseToggleSwitches() { initialiseToggleSwitch(&BUTTON_1_1); }
+void addMatrixKeys() {
+  for (uint8_t row = 0; row < 3; row++) {
+    for (uint8_t col = 0; col < 5; col++) {
+      layout.add(pushEntry(KIND_MATRIX, MATRIX_ROW_PINS[row],
+                           MATRIX_COL_PINS[col], MATRIX_KEYS[row][col],
+                           PROFILE_MATRIX));
+    }
+  }
+}
 
-void initialiseDoubleToggleSwitch(ToggleSwitchDouble *toggleSwitch) {
-  switches.addSwitchListener(toggleSwitch->pinUp,
-                             new ClickListener(toggleSwitch->buttonUp),
-                             NO_REPEAT);
-  switches.addSwitchListener(toggleSwitch->pinDown,
-                             new ClickListener(toggleSwitch->buttonDown),
-                             NO_REPEAT);
+// every input of every expander chip, as push buttons in chip order
+void addExpanderInputs() {
+#if MCP23017_CHIPS > 0
+  for (uint8_t chip = 0; chip < MCP23017_CHIPS; chip++) {
+    for (uint8_t pin = 0; pin < 16; pin++) {
+      layout.add(LayoutEntry{KIND_EXPANDER, 0, pin, chip,
+                             uint8_t(EXPANDER_FIRST_BUTTON + chip * 16 + pin),
+                             LAYOUT_NO_BUTTON, PROFILE_MATRIX});
+    }
+  }
+#endif
 }
 
-void initialiseDoubleToggleSwitches() {
-  initialiseDoubleToggleSwitch(&BUTTON_2_1);
-  initialiseDoubleToggleSwitch(&BUTTON_2_2);
-  initialiseDoubleToggleSwitch(&BUTTON_2_3);
-  initialiseDoubleToggleSwitch(&BUTTON_2_4);
-  initialiseDoubleToggleSwitch(&BUTTON_2_5);
+// every input of the chain as push buttons, in the slots its bits land in
+void addShiftInputs() {
+#if SHIFT_CHIPS > 0
+  while (layout.staging().header.count < SHIFT_FIRST_SLOT) {
+    layout.add(LayoutEntry{KIND_NONE, 0, LAYOUT_NO_PIN, LAYOUT_NO_PIN,
+                           LAYOUT_NO_BUTTON, LAYOUT_NO_BUTTON, 0});
+  }
+  for (uint8_t i = 0; i < SHIFT_CHIPS * 8; i++) {
+    layout.add(LayoutEntry{KIND_SHIFT, 0, LAYOUT_NO_PIN, LAYOUT_NO_PIN,
+                           uint8_t(SHIFT_FIRST_BUTTON + i), LAYOUT_NO_BUTTON,
+                           PROFILE_MATRIX});
+  }
+#endif
 }
 
-void initaliseEncoder(uint8_t slot, MyEncoder *e) {
-  encoders[slot] = e;
-  e->button = new EncoderButton(e->pinA, e->pinB, e->pinClick);
-  e->button->useQuadPrecision(e->useQuadPrecision);
+/**
+ * Builds the layout from the BUTTON_x_y definitions, used when there is no
+ * valid layout in EEPROM.
+ */
+void initialiseDefaultLayout() {
+  layout.clearStaging();
+
+  if (SHIFT_CHIPS == 0) {
+    // with layers enabled the first toggle switches between them
+    uint8_t toggle =
+        addToggleSwitch(&BUTTON_1_1, LAYER_COUNT > 1 ? FLAG_LAYER_SELECT : 0);
+    addCentre(BUTTON_1_2.button, toggle);
+    addPushButton(&BUTTON_1_3);
+  }
 
-  EncoderRotateListener *cb =
-      new EncoderRotateListener(e->buttonLeft, e->buttonRight);
-  e->rotateListener = cb;
-  e->button->setEncoderHandler(*cb);
+  addDoubleToggleSwitch(&BUTTON_2_1);
+  addDoubleToggleSwitch(&BUTTON_2_2);
+  addDoubleToggleSwitch(&BUTTON_2_3);
+  addDoubleToggleSwitch(&BUTTON_2_4);
+  if (SHIFT_CHIPS == 0) {
+    addDoubleToggleSwitch(&BUTTON_2_5);
+  }
 
-  switches.addSwitchListener(e->pinClick, new ClickListener(e->buttonClick),
-                             NO_REPEAT);
-}
+  addEncoder(&BUTTON_3_1);
+  addEncoder(&BUTTON_3_2);
+  addEncoder(&BUTTON_3_3);
+  addEncoder(&BUTTON_3_4);
 
-void initialiseEncoders() {
-  initaliseEncoder(0, &BUTTON_3_1);
-  initaliseEncoder(1, &BUTTON_3_2);
-  initaliseEncoder(2, &BUTTON_3_3);
-  initaliseEncoder(3, &BUTTON_3_4);
-
-  initaliseEncoder(4, &BUTTON_7_1);
-  initaliseEncoder(5, &BUTTON_7_2);
-  initaliseEncoder(6, &BUTTON_7_3);
-
-  taskManager.schedule(repeatMillis(10), [] {
-    for (MyEncoder *e : encoders) {
-      if (e != NULL) {
-        e->button->update();
-      }
-    }
-  });
+  addMatrixKeys();
+
+  if (MCP23017_CHIPS > 0) {
+    addExpanderInputs();
+  } else {
+    addEncoder(&BUTTON_7_1);
+  }
+  addEncoder(&BUTTON_7_2);
+  if (SHIFT_CHIPS > 0) {
+    addShiftInputs();
+  } else {
+    addEncoder(&BUTTON_7_3);
+  }
+
+  memcpy(layout.staging().header.debounce, DEBOUNCE_PROFILES,
+         sizeof(DEBOUNCE_PROFILES));
+  layout.seal(ENCODER_PULSE_MS);
+  layout.stage();
+  layout.commit();
 }
 
 void setup() {
@@ -379,29 +393,37 @@ void setup() {
 
   startTaskManagerLogDelegate();
 
-  // our next task is to initialise swtiches, do this BEFORE doing anything else
-  // with switches. We choose to initialise in poll everything (requires no
-  // interrupts), but there are other modes too: (SWITCHES_NO_POLLING -
-  // interrupt only) or (SWITCHES_POLL_KEYS_ONLY - encoders on interrupt)
-  switches.init(asIoRef(internalDigitalDevice()), SWITCHES_NO_POLLING, true);
-
-  // here you can choose between two stock configurations or you could alter one
-  // of the methods to meet your hardware requirements.
-  initialiseKeyboard3X5();
-
-  initialisePushButtons();
-  initialiseToggleSwitches();
-  initialiseDoubleToggleSwitches();
-  initialiseEncoders();
+  // the macros come first, a layout that starts one is checked against them
+  chords.define(CHORDS, sizeof(CHORDS) / sizeof(CHORDS[0]));
+  macros.define(MACROS, sizeof(MACROS) / sizeof(MACROS[0]));
+  layout.macroCheck = [](uint8_t macro) { return macros.valid(macro); };
+  if (!loadStoredLayout()) {
+    initialiseDefaultLayout();
+  }
 
-  // now set up the repeat key start and interval
-  // keyboard.setRepeatKeyMillis(850, 350);
+  deferred.begin(millis());
+  scanner.begin();
+  analogPort.begin();
+  encoderPort.begin();
+  linkPort.begin();
 
   /* digitalWrite(LED_BUILTIN, LOW); */
-  Serial.println("Keyboard is initialised!");
+  Serial.println("Button box is initialised!");
 }
 
 void loop() {
-  // as this indirectly uses taskmanager, we must include this in loop.
+  profiler.loop();
   taskManager.runLoop();
+  profiler.run(TASK_ENCODERS, [] { encoderPort.poll(); });
+  profiler.run(TASK_DEFERRED, [] {
+    if (uint8_t fired = deferred.advance(millis())) {
+      telemetryPort.trace(TRACE_TIMER, 0, fired);
+    }
+  });
+  profiler.run(TASK_ANALOG, [] { analogPort.poll(); });
+  profiler.run(TASK_CONSOLE, [] { console.poll(); });
+  profiler.run(TASK_TELEMETRY, [] { telemetryPort.poll(); });
+  profiler.run(TASK_USB, [] { usbResync.poll(); });
+  profiler.run(TASK_LINK, [] { linkPort.poll(); });
+  profiler.run(TASK_STORE, [] { pollLayoutStore(); });
 }
@@ -0,0 +1,83 @@
+#include "mcp23017.h"
+
+void ExpanderChain::begin(uint8_t chips) {
+  count = chips < MCP23017_MAX_CHIPS ? chips : MCP23017_MAX_CHIPS;
+  // pulled up inputs read high until the first burst says otherwise
+  for (uint8_t c = 0; c < MCP23017_MAX_CHIPS; c++) {
+    words[c] = 0xFFFF;
+  }
+  busy = false;
+  unreported = false;
+}
+
+/**
+ * Starts a burst unless one is running. An edge during a burst is not lost:
+ * the chip keeps INT asserted until its ports are read again, and the caller
+ * starts another burst when it finds the line still low.
+ */
+void ExpanderChain::interrupt(uint32_t cycles) {
+  if (busy || count == 0) {
+    return;
+  }
+  edge = cycles;
+  if (!unreported) {
+    firstEdge = cycles;
+  }
+  current = 0;
+  busy = true;
+  bus.startRead(MCP23017_ADDRESS + current, 2);
+}
+
+/**
+ * Moves the running burst along, returns true once every chip has been read.
+ * A failed read is retried on the next poll.
+ */
+bool ExpanderChain::poll(uint32_t cycles) {
+  if (!busy) {
+    return false;
+  }
+  uint8_t data[2];
+  switch (bus.poll(data, sizeof(data))) {
+  case I2cBus::BUSY:
+    return false;
+  case I2cBus::FAILED:
+    errors++;
+    bus.startRead(MCP23017_ADDRESS + current, 2);
+    return false;
+  case I2cBus::DONE:
+    break;
+  }
+
+  words[current] = data[0] | (data[1] << 8);
+  if (++current < count) {
+    bus.startRead(MCP23017_ADDRESS + current, 2);
+    return false;
+  }
+  reads++;
+  edgeToData.add(cycles - edge);
+  unreported = true;
+  busy = false;
+  return true;
+}
+
+/**
+ * Called after poll() with the level of INT. A chip keeps INT asserted when
+ * an edge came in after its ports were read, so an idle chain that still
+ * sees it starts another burst and no edge is lost.
+ */
+void ExpanderChain::recheck(uint32_t cycles, bool asserted) {
+  if (!busy && asserted) {
+    interrupt(cycles);
+  }
+}
+
+/**
+ * Called when a debounced expander input changed the report, which closes
+ * the edge to report measurement.
+ */
+void ExpanderChain::reported(uint32_t cycles) {
+  if (unreported) {
+    edgeToReport.add(cycles - firstEdge);
+    unreported = false;
+  }
+}
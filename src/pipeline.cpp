@@ -0,0 +1,216 @@
+#include "pipeline.h"
+
+#include "chords.h"
+#include "gestures.h"
+#include "input_counters.h"
+#include "macros.h"
+
+namespace {
+
+inline uint64_t normalise(const LayoutTable &t, uint8_t w, uint64_t level) {
+  // inputs are active low unless flagged otherwise
+  return ~(level ^ t.activeHigh[w]) & t.inputMask[w];
+}
+
+inline uint64_t bitOf(const uint64_t *state, uint8_t slot) {
+  return (state[slot >> 6] >> (slot & 63)) & 1;
+}
+
+/**
+ * Normalises a sample and adds the centre positions, a NOR of the pole bits
+ * of the same sample, so they are debounced along with everything else.
+ */
+inline void normalise(const LayoutTable &t, const uint64_t *raw,
+                      uint64_t *state) {
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    state[w] = normalise(t, w, raw[w]);
+  }
+  for (uint8_t k = 0; k < t.centres; k++) {
+    uint8_t slot = t.centre[k];
+    const LayoutEntry &e = t.blob.entries[slot];
+    uint64_t on = bitOf(state, e.pin);
+    if (e.pin2 != LAYOUT_NO_PIN) {
+      on |= bitOf(state, e.pin2);
+    }
+    state[slot >> 6] |= (on ^ 1) << (slot & 63);
+  }
+}
+
+} // namespace
+
+/**
+ * Takes the first sample as the truth, without debouncing, so toggles that
+ * are already on show up in the very first report.
+ */
+void InputPipeline::begin(const uint64_t *raw) {
+  const LayoutTable &t = layout.active();
+  uint64_t state[INPUT_WORDS];
+  normalise(t, raw, state);
+  applyProfiles(t);
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    debounce[w].reset(state[w]);
+  }
+  if (counters) {
+    counters->reset(state);
+  }
+  layer = selectedLayer();
+  if (chords) {
+    chords->configure(t);
+  }
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    press(w, debounce[w].stable, true);
+  }
+  sink.flush();
+}
+
+/**
+ * Releases everything that is held, used before the layout is swapped so no
+ * button of the old map stays stuck. The caller flushes after begin().
+ */
+void InputPipeline::end() {
+  if (gestures) {
+    gestures->end();
+  }
+  if (chords) {
+    chords->end();
+  }
+  if (macros) {
+    macros->end();
+  }
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    press(w, debounce[w].stable, false);
+  }
+}
+
+bool InputPipeline::scan(const uint64_t *raw) {
+  const LayoutTable &t = layout.active();
+  uint64_t state[INPUT_WORDS], flipped[INPUT_WORDS], stable[INPUT_WORDS];
+  uint64_t any = 0;
+  normalise(t, raw, state);
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    flipped[w] = debounce[w].update(state[w]);
+    stable[w] = debounce[w].stable;
+    any |= flipped[w];
+  }
+  if (counters) {
+    counters->sample(state, flipped, stable, t.eagerMask);
+  }
+  if (acceptHook && any) {
+    acceptHook(flipped, stable);
+  }
+
+  // held back chord presses need scans of their own to time out
+  if (any || (chords && chords->waiting())) {
+    uint8_t next = selectedLayer();
+    if (next != layer) {
+      // whatever was held goes up in the old layer and down in the new one,
+      // so nothing stays stuck in a layer that is no longer selected
+      if (chords) {
+        chords->end();
+      }
+      if (gestures) {
+        gestures->end();
+      }
+      for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+        press(w, debounce[w].stable ^ flipped[w], false);
+      }
+      layer = next;
+      for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+        press(w, debounce[w].stable, true);
+      }
+    } else {
+      uint64_t down[INPUT_WORDS], up[INPUT_WORDS];
+      for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+        down[w] = flipped[w] & stable[w];
+        up[w] = flipped[w] & ~stable[w];
+      }
+      if (chords) {
+        chords->filter(down, up, stable);
+      }
+      for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+        press(w, down[w], true);
+        press(w, up[w], false);
+      }
+    }
+    if (gestures) {
+      for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+        uint64_t bits = flipped[w] & t.gestureMask[w];
+        while (bits) {
+          uint8_t bit = __builtin_ctzll(bits);
+          bits &= bits - 1;
+          gestures->input((w << 6) | bit, (debounce[w].stable >> bit) & 1);
+        }
+      }
+    }
+    if (macros) {
+      for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+        uint64_t bits = flipped[w] & debounce[w].stable & t.macroMask[w];
+        while (bits) {
+          uint8_t slot = (w << 6) | __builtin_ctzll(bits);
+          bits &= bits - 1;
+          macros->start(layout.entry(slot).button2);
+        }
+      }
+    }
+  }
+  sink.flush();
+  return any != 0;
+}
+
+void InputPipeline::setDebounce(uint16_t ms, uint32_t scanUs) {
+  this->scanUs = scanUs;
+  samples = toSamples(ms);
+  applyProfiles(layout.active());
+}
+
+// clamped to what the planes count, see maxDebounceMs()
+uint8_t InputPipeline::toSamples(uint16_t ms) const {
+  uint32_t n = (ms * 1000UL + scanUs - 1) / scanUs;
+  return n < DEBOUNCE_MAX_SAMPLES ? n : DEBOUNCE_MAX_SAMPLES;
+}
+
+/**
+ * Turns the debounce profiles of a layout into the threshold planes and the
+ * eager mask of the debouncers, one masked store per profile and word.
+ */
+void InputPipeline::applyProfiles(const LayoutTable &t) {
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    debounce[w].setThreshold(~0ULL, samples, samples);
+    debounce[w].eager = t.eagerMask[w];
+  }
+  for (uint8_t p = 0; p < LAYOUT_PROFILES; p++) {
+    const DebounceProfile &d = t.blob.header.debounce[p];
+    uint8_t press = d.pressMs ? toSamples(d.pressMs) : samples;
+    uint8_t release = d.releaseMs ? toSamples(d.releaseMs) : samples;
+    for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+      debounce[w].setThreshold(t.profileMask[p][w], press, release);
+      debounce[w].setLockout(t.profileMask[p][w], press);
+    }
+  }
+}
+
+uint8_t InputPipeline::selectedLayer() const {
+  const LayoutTable &t = layout.active();
+  uint8_t selected = 0;
+  for (uint8_t k = 0; k < t.selectors; k++) {
+    uint8_t s = t.selector[k];
+    selected |= ((debounce[s >> 6].stable >> (s & 63)) & 1) << k;
+  }
+  return selected & (LAYER_COUNT - 1);
+}
+
+void InputPipeline::press(uint8_t word, uint64_t bits, bool pressed) {
+  uint64_t selectors = layout.active().selectorMask[word];
+  while (bits) {
+    uint8_t bit = __builtin_ctzll(bits);
+    uint8_t slot = (word << 6) | bit;
+    bits &= bits - 1;
+    uint8_t button = layout.entry(slot).button;
+    if (!((selectors >> bit) & 1)) {
+      button = map(button);
+    }
+    if (button != LAYOUT_NO_BUTTON) {
+      sink.button(button, pressed);
+    }
+  }
+}
@@ -0,0 +1,31 @@
+#include "profiler.h"
+
+Profiler profiler;
+
+#if PROFILE_ENABLED
+
+namespace {
+
+const char *const NAMES[TASK_COUNT] = {
+    "scan", "encoders", "deferred", "analog", "console",
+    "telemetry", "usb", "link", "store",
+};
+
+} // namespace
+
+/**
+ * Starts over, the next loop() only sets the start of the first period.
+ */
+void Profiler::clear() {
+  for (uint8_t i = 0; i < TASK_COUNT; i++) {
+    tasks[i] = TaskProfile{0, UINT32_MAX, 0, 0};
+  }
+  loopPeriod.clear();
+  lastLoop = 0;
+}
+
+const char *Profiler::name(uint8_t task) {
+  return task < TASK_COUNT ? NAMES[task] : "?";
+}
+
+#endif
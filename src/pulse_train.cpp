@@ -0,0 +1,97 @@
+#include "pulse_train.h"
+
+#include "deferred.h"
+#include "layout.h"
+
+PulseTrains pulseTrains;
+
+namespace {
+
+int16_t clampQueue(int16_t queued) {
+  return queued < -ENCODER_MAX_QUEUED  ? -ENCODER_MAX_QUEUED
+         : queued > ENCODER_MAX_QUEUED ? ENCODER_MAX_QUEUED
+                                       : queued;
+}
+
+} // namespace
+
+void PulseTrains::attach(uint8_t n, uint8_t slot) {
+  trains[n] = Train{slot, 0, 0, IDLE, LAYOUT_NO_BUTTON};
+}
+
+/**
+ * Queues signed plain and fast steps on train n. Turning the other way drops
+ * whatever the old direction still had queued.
+ */
+void PulseTrains::step(uint8_t n, int16_t steps, int16_t fast) {
+  Train &t = trains[n];
+  int16_t dir = steps ? steps : fast;
+  if (dir == 0) {
+    return;
+  }
+  if ((dir > 0) != (t.queued > 0 || t.fast > 0)) {
+    t.queued = 0;
+    t.fast = 0;
+  }
+  t.queued = clampQueue(t.queued + steps);
+  t.fast = clampQueue(t.fast + fast);
+  if (t.phase == IDLE) {
+    startPulse(n);
+  }
+}
+
+/**
+ * Presses the button of the next queued step and keeps it down for the
+ * pulse width of the layout, so every step shows up on the host as a click.
+ */
+void PulseTrains::startPulse(uint16_t n) {
+  PulseTrains &p = pulseTrains;
+  Train &t = p.trains[n];
+  if (t.queued == 0 && t.fast == 0) {
+    t.phase = IDLE;
+    return;
+  }
+  // a layout swap can take the fast buttons away, their steps go plain
+  uint8_t fastSlot = layout.fastSlot(t.slot);
+  bool fast = t.fast != 0;
+  int16_t &queued = fast ? t.fast : t.queued;
+  const LayoutEntry &e =
+      layout.entry(fast && fastSlot != LAYOUT_NO_PIN ? fastSlot : t.slot);
+  int8_t dir = queued > 0 ? 1 : -1;
+  queued -= dir;
+  t.button = p.pipeline->map(dir > 0 ? e.button : e.button2);
+  if (t.button != LAYOUT_NO_BUTTON) {
+    p.sink->button(t.button, true);
+    p.sink->flush();
+  }
+  t.phase = PRESSED;
+  if (!deferred.schedule(layout.pulseMs(), endPulse, n)) {
+    // no timer left, better a short click than a stuck button
+    t.queued = 0;
+    t.fast = 0;
+    endPulse(n);
+  }
+}
+
+/**
+ * Releases the button and, when more steps are queued, waits another pulse
+ * width so the host sees the release before the next press.
+ */
+void PulseTrains::endPulse(uint16_t n) {
+  PulseTrains &p = pulseTrains;
+  Train &t = p.trains[n];
+  if (t.button != LAYOUT_NO_BUTTON) {
+    p.sink->button(t.button, false);
+    p.sink->flush();
+  }
+  if (t.queued == 0 && t.fast == 0) {
+    t.phase = IDLE;
+    return;
+  }
+  t.phase = GAP;
+  if (!deferred.schedule(layout.pulseMs(), startPulse, n)) {
+    t.queued = 0;
+    t.fast = 0;
+    t.phase = IDLE;
+  }
+}
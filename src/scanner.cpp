@@ -0,0 +1,271 @@
+#include "scanner.h"
+
+#include <string.h>
+
+#include "chords.h"
+#include "gestures.h"
+#include "input_counters.h"
+#include "macros.h"
+#include "profiler.h"
+
+ScanStats scanStats;
+InputCounters inputCounters;
+JoystickSink joystickSink;
+InputPipeline pipeline(layout, joystickSink);
+Scanner scanner;
+
+void Scanner::begin() {
+  Joystick.useManualSend(true);
+#if JOYSTICK_SIZE == 64
+  // all four hats centred, a zero would read as pushed forward
+  usb_joystick_data[15] |= 0xFFFF0000;
+#endif
+  expanderPort.begin();
+  shiftChain.begin();
+  configure();
+  sample();
+  gestures.begin(joystickSink, pipeline);
+  chords.begin(joystickSink);
+  macros.begin(joystickSink, [] { return uint32_t(micros()); });
+  pipeline.setGestures(&gestures);
+  pipeline.setChords(&chords);
+  pipeline.setMacros(&macros);
+  pipeline.setCounters(&inputCounters);
+  pipeline.setAcceptHook([](const uint64_t *flipped, const uint64_t *stable) {
+    scanner.traceAccepts(flipped, stable);
+  });
+  pipeline.begin(level);
+  setScanMicros(scanUs);
+}
+
+void Scanner::setScanMicros(uint32_t us) {
+  scanUs = us;
+  setDebounceMillis(debounceMs);
+  if (task != TASKMGR_INVALIDID) {
+    taskManager.cancelTask(task);
+  }
+  task = taskManager.schedule(repeatMicros(scanUs), [] {
+    profiler.run(TASK_SCAN, [] { scanner.tick(); });
+  });
+}
+
+void Scanner::setDebounceMillis(uint16_t ms) {
+  debounceMs = ms;
+  pipeline.setDebounce(ms, scanUs);
+}
+
+uint8_t Scanner::portOf(uint8_t pin) {
+  volatile uint32_t *reg = portInputRegister(pin);
+  for (uint8_t p = 0; p < portCount; p++) {
+    if (ports[p] == reg) {
+      return p;
+    }
+  }
+  ports[portCount] = reg;
+  return portCount++;
+}
+
+void Scanner::addGather(uint8_t pin, uint8_t slot) {
+  pinMode(pin, INPUT_PULLUP);
+  table[tableCount++] =
+      GatherEntry{.mask = digitalPinToBitMask(pin), .port = portOf(pin),
+                  .slot = slot};
+}
+
+/**
+ * Builds the gather table from the active layout: direct pins and expander
+ * inputs first, then the matrix keys grouped by row so each row is one
+ * contiguous range.
+ */
+void Scanner::configure() {
+  const LayoutBlob &blob = layout.active().blob;
+  portCount = 0;
+  tableCount = 0;
+  rowCount = 0;
+  activeRow = 0;
+  memset(directMask, 0, sizeof(directMask));
+  memset(expanderMask, 0, sizeof(expanderMask));
+  memset(shiftMask, 0, sizeof(shiftMask));
+  // unread matrix keys must look released, and released is high
+  memset(level, 0xFF, sizeof(level));
+
+  for (uint8_t i = 0; i < blob.header.count; i++) {
+    const LayoutEntry &e = blob.entries[i];
+    if ((e.kind == KIND_PUSH || e.kind == KIND_TOGGLE) &&
+        e.pin < CORE_NUM_DIGITAL && !busPin(e.pin)) {
+      addGather(e.pin, i);
+      directMask[i >> 6] |= 1ULL << (i & 63);
+    } else if (e.kind == KIND_EXPANDER && e.pin < 16 &&
+               e.pin2 < expanderPort.chips()) {
+      table[tableCount++] =
+          GatherEntry{.mask = uint32_t(1) << e.pin,
+                      .port = uint8_t(SCAN_MAX_PORTS + e.pin2), .slot = i};
+      directMask[i >> 6] |= 1ULL << (i & 63);
+      expanderMask[i >> 6] |= 1ULL << (i & 63);
+    } else if (e.kind == KIND_SHIFT && i >= SHIFT_FIRST_SLOT &&
+               i < SHIFT_FIRST_SLOT + SHIFT_CHIPS * 8) {
+      shiftMask[(i >> 6) - SHIFT_FIRST_WORD] |= 1ULL << (i & 63);
+    }
+  }
+  directCount = tableCount;
+
+  for (uint8_t i = 0; i < blob.header.count; i++) {
+    const LayoutEntry &e = blob.entries[i];
+    if (e.kind != KIND_MATRIX || e.pin >= CORE_NUM_DIGITAL ||
+        e.pin2 >= CORE_NUM_DIGITAL || busPin(e.pin)) {
+      continue;
+    }
+    bool known = false;
+    for (uint8_t r = 0; r < rowCount; r++) {
+      known |= rows[r].pin == e.pin;
+    }
+    if (known || rowCount == SCAN_MAX_ROWS) {
+      continue;
+    }
+
+    MatrixRow &row = rows[rowCount++];
+    row.pin = e.pin;
+    row.first = tableCount;
+    memset(row.mask, 0, sizeof(row.mask));
+    for (uint8_t k = i; k < blob.header.count; k++) {
+      const LayoutEntry &key = blob.entries[k];
+      if (key.kind == KIND_MATRIX && key.pin == e.pin &&
+          key.pin2 < CORE_NUM_DIGITAL && !busPin(key.pin2)) {
+        addGather(key.pin2, k);
+        row.mask[k >> 6] |= 1ULL << (k & 63);
+      }
+    }
+    row.count = tableCount - row.first;
+    driveRow(rowCount - 1, false);
+  }
+
+  if (rowCount) {
+    driveRow(activeRow, true);
+  }
+}
+
+/**
+ * Idle rows float so two keys pressed in the same column never short a high
+ * row against the active low one.
+ */
+void Scanner::driveRow(uint8_t row, bool active) {
+  if (active) {
+    pinMode(rows[row].pin, OUTPUT);
+    digitalWriteFast(rows[row].pin, LOW);
+  } else {
+    pinMode(rows[row].pin, INPUT);
+  }
+}
+
+void Scanner::sample() {
+  uint32_t words[SCAN_MAX_WORDS];
+  for (uint8_t p = 0; p < portCount; p++) {
+    words[p] = *ports[p];
+  }
+  expanderPort.poll();
+  for (uint8_t c = 0; c < expanderPort.chips(); c++) {
+    words[SCAN_MAX_PORTS + c] = expanderPort.word(c);
+  }
+
+  uint64_t got[INPUT_WORDS] = {};
+  gatherPorts(words, table, directCount, got);
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    level[w] = (level[w] & ~directMask[w]) | got[w];
+  }
+
+#if SHIFT_CHIPS > 0
+  shiftChain.merge(level, shiftMask);
+#endif
+
+  if (rowCount) {
+    const MatrixRow &row = rows[activeRow];
+    memset(got, 0, sizeof(got));
+    gatherPorts(words, table + row.first, row.count, got);
+    for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+      level[w] = (level[w] & ~row.mask[w]) | got[w];
+    }
+    driveRow(activeRow, false);
+    activeRow = activeRow + 1 < rowCount ? activeRow + 1 : 0;
+    driveRow(activeRow, true);
+  }
+}
+
+/**
+ * Swaps in a pending layout between two scans: everything held is released
+ * through the old map, and the new map starts from a fresh sample, all in
+ * the same report.
+ */
+void Scanner::swapLayout() {
+  pipeline.end();
+  layout.commit();
+  configure();
+  sample();
+  pipeline.begin(level);
+}
+
+/**
+ * Traces every input whose sampled level differs from the last scan, with
+ * the time of the sample.
+ */
+void Scanner::traceEdges(uint32_t cycles) {
+  const LayoutTable &t = layout.active();
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    uint64_t edges = (level[w] ^ traced[w]) & t.inputMask[w];
+    while (edges) {
+      uint8_t bit = __builtin_ctzll(edges);
+      edges &= edges - 1;
+      telemetryPort.trace(TRACE_EDGE, (w << 6) | bit, (level[w] >> bit) & 1,
+                          cycles);
+    }
+  }
+}
+
+/**
+ * Traces every debounced change with the time of the sample that decided
+ * it. The pipeline calls this before the changes reach the report, so the
+ * records stay in time order with the buttons and the report they cause.
+ */
+void Scanner::traceAccepts(const uint64_t *flipped, const uint64_t *stable) {
+  if (!telemetryPort.tracing()) {
+    return;
+  }
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    uint64_t bits = flipped[w];
+    while (bits) {
+      uint8_t bit = __builtin_ctzll(bits);
+      bits &= bits - 1;
+      telemetryPort.trace(TRACE_ACCEPT, (w << 6) | bit,
+                          (stable[w] >> bit) & 1, sampled);
+    }
+  }
+}
+
+void Scanner::tick() {
+  uint32_t start = ARM_DWT_CYCCNT;
+  if (layout.pending()) {
+    swapLayout();
+  } else {
+    sample();
+    sampled = ARM_DWT_CYCCNT;
+    if (telemetryPort.tracing()) {
+      traceEdges(sampled);
+    }
+    uint64_t before[INPUT_WORDS];
+    for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+      before[w] = pipeline.stable(w);
+    }
+    if (pipeline.scan(level)) {
+      // an expander input made it into the report, close its latency sample
+      uint64_t changed = 0;
+      for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+        changed |= (pipeline.stable(w) ^ before[w]) & expanderMask[w];
+      }
+      if (changed) {
+        expanderPort.reported();
+      }
+    }
+  }
+  memcpy(traced, level, sizeof(traced));
+  scanStats.scans++;
+  scanStats.scanCycles.add(ARM_DWT_CYCCNT - start);
+}
@@ -0,0 +1,48 @@
+#include "shift_chain.h"
+
+ShiftChain shiftChain;
+
+#if SHIFT_CHIPS > 0
+
+#include <SPI.h>
+
+// how long begin() waits for the first sample
+#define SHIFT_BEGIN_TIMEOUT_US 10000
+
+/**
+ * Takes the bus for good and reads the chain once, so the first scan already
+ * sees the real levels.
+ */
+void ShiftChain::begin() {
+  sampler.begin();
+  pinMode(SHIFT_LOAD_PIN, OUTPUT);
+  digitalWriteFast(SHIFT_LOAD_PIN, HIGH);
+  SHIFT_SPI.begin();
+  SHIFT_SPI.beginTransaction(SPISettings(SHIFT_SPI_HZ, MSBFIRST, SPI_MODE0));
+  done.attachImmediate(onDone);
+
+  elapsedMicros waited;
+  onTimer();
+  while (sampler.running() && waited < SHIFT_BEGIN_TIMEOUT_US) {
+  }
+  timer.begin(onTimer, SHIFT_SAMPLE_US);
+}
+
+void ShiftChain::onTimer() {
+  ShiftChain &c = shiftChain;
+  uint8_t *buffer = c.sampler.start();
+  if (!buffer) {
+    return;
+  }
+  // a short low pulse on PL copies the inputs into the registers
+  digitalWriteFast(SHIFT_LOAD_PIN, LOW);
+  delayNanoseconds(100);
+  digitalWriteFast(SHIFT_LOAD_PIN, HIGH);
+  SHIFT_SPI.transfer(nullptr, buffer, SHIFT_CHIPS, c.done);
+}
+
+void ShiftChain::onDone(EventResponder &event) {
+  shiftChain.sampler.done();
+}
+
+#endif
@@ -0,0 +1,165 @@
+#include "telemetry_port.h"
+
+#include <string.h>
+
+#include "stats.h"
+
+TelemetryPort telemetryPort;
+
+#if defined(RAWHID_INTERFACE)
+
+void TelemetryPort::poll() {
+  if (RawHID.available()) {
+    TelemetryPacket p;
+    if (RawHID.recv(&p, 0) == TELEMETRY_PACKET_SIZE) {
+      receive(p);
+    }
+  }
+
+  if ((streams & STREAM_COUNTERS) &&
+      millis() - lastCountersMs >= TELEMETRY_COUNTERS_MS) {
+    lastCountersMs = millis();
+    sendCounters();
+  }
+  if ((streams & STREAM_TRACE) &&
+      millis() - lastClockMs >= TELEMETRY_CLOCK_MS) {
+    traceClock();
+  }
+  // don't sit on a half full trace packet while the channel is idle
+  if (openTrace && ring.empty()) {
+    closeTrace();
+  }
+
+  TelemetryPacket *p = ring.front();
+  if (!p) {
+    return;
+  }
+  // a send only goes out on a free transmit slot, even a timeout of 0 would
+  // otherwise hold the loop up to the next ms tick
+  if (RawHID.txAvailable() && RawHID.send(p, 0) > 0) {
+    ring.pop();
+    lastSentMs = millis();
+  } else if (millis() - lastSentMs >= TELEMETRY_STALL_MS) {
+    // the host stopped reading, drop everything until it subscribes again
+    streams = 0;
+    openTrace = nullptr;
+    while (ring.front()) {
+      ring.pop();
+    }
+  }
+}
+
+TelemetryPacket *TelemetryPort::acquire(uint8_t type) {
+  // an open trace packet holds the next slot, it has to go out first
+  if (type != TM_TRACE) {
+    closeTrace();
+  }
+  TelemetryPacket *p = ring.acquire();
+  if (!p) {
+    dropped++;
+    return nullptr;
+  }
+  p->type = type;
+  p->seq = seq++;
+  p->length = 0;
+  p->flags = 0;
+  return p;
+}
+
+void TelemetryPort::publish(TelemetryPacket *p) { ring.publish(); }
+
+void TelemetryPort::appendTrace(uint8_t event, uint8_t slot, uint16_t arg,
+                                uint32_t cycles) {
+  if (!openTrace && !(openTrace = acquire(TM_TRACE))) {
+    return;
+  }
+  TraceRecord r = {cycles, event, slot, arg};
+  memcpy(openTrace->payload + openTrace->length, &r, sizeof(r));
+  openTrace->length += sizeof(r);
+  if (openTrace->length >= TELEMETRY_TRACE_RECORDS * sizeof(TraceRecord)) {
+    closeTrace();
+  }
+}
+
+void TelemetryPort::traceClock() {
+  lastClockMs = millis();
+  appendTrace(TRACE_CLOCK, 0, F_CPU_ACTUAL / 1000000, ARM_DWT_CYCCNT);
+}
+
+void TelemetryPort::closeTrace() {
+  if (openTrace) {
+    openTrace = nullptr;
+    ring.publish();
+  }
+}
+
+void TelemetryPort::receive(const TelemetryPacket &p) {
+  switch (p.type) {
+  case TM_SUBSCRIBE:
+    streams = p.payload[0];
+    lastSentMs = millis();
+    if (!(streams & STREAM_TRACE)) {
+      closeTrace();
+    }
+    ack(p.type, 0);
+    if (streams & STREAM_TRACE) {
+      // the rate comes first so the host can convert from the start
+      traceClock();
+    }
+    break;
+
+  case TM_LAYOUT:
+    for (uint8_t i = 0; i < p.length && i < TELEMETRY_PAYLOAD_SIZE; i++) {
+      LayoutReceiver::Result result =
+          layoutReceiver.feed(p.payload[i], millis());
+      if (result != LayoutReceiver::MORE) {
+        ack(p.type, result == LayoutReceiver::DONE ? 0 : 1);
+      }
+    }
+    break;
+
+  default:
+    ack(p.type, 0xFF);
+    break;
+  }
+}
+
+void TelemetryPort::sendCounters() {
+  TelemetryPacket *p = acquire(TM_COUNTERS);
+  if (!p) {
+    return;
+  }
+  CountersPayload c = {millis(), scanStats.scans, scanStats.events,
+                       scanStats.reports, dropped};
+  memcpy(p->payload, &c, sizeof(c));
+  p->length = sizeof(c);
+  publish(p);
+
+  for (uint8_t first = 0; first < HISTOGRAM_BINS;
+       first += TELEMETRY_HISTOGRAM_BINS) {
+    if (!(p = acquire(TM_HISTOGRAM))) {
+      return;
+    }
+    HistogramPayload h = {};
+    h.id = HISTOGRAM_SCAN_CYCLES;
+    h.first = first;
+    h.count = min(HISTOGRAM_BINS - first, TELEMETRY_HISTOGRAM_BINS);
+    memcpy(h.bins, scanStats.scanCycles.bins + first, h.count * 4);
+    memcpy(p->payload, &h, sizeof(h));
+    p->length = sizeof(h);
+    publish(p);
+  }
+}
+
+void TelemetryPort::ack(uint8_t type, uint8_t status) {
+  TelemetryPacket *p = acquire(TM_ACK);
+  if (!p) {
+    return;
+  }
+  p->payload[0] = type;
+  p->payload[1] = status;
+  p->length = sizeof(AckPayload);
+  publish(p);
+}
+
+#endif // RAWHID_INTERFACE
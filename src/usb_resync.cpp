@@ -0,0 +1,64 @@
+#include "usb_resync.h"
+
+UsbResync usbResync;
+
+void UsbResync::poll() {
+  // configured is cleared by a bus reset and set again on enumeration
+  bool suspended = USB1_PORTSC1 & USB_PORTSC1_SUSP;
+  bool up = usb_configuration && !suspended;
+  // the stamp also catches a reset and enumeration quick enough to fall
+  // between two polls; the USB interrupt writes it, so it is taken and
+  // cleared in one go
+  noInterrupts();
+  uint32_t configuredUs = usb_joystick_configured_us;
+  usb_joystick_configured_us = 0;
+  interrupts();
+  if ((up && !wasUp) || configuredUs) {
+    pending = true;
+  }
+  if (configuredUs) {
+    eventUs = configuredUs;
+    timed = true;
+  } else if (up && wasSuspended) {
+    // a resume, timed from the poll that sees SUSP clear
+    eventUs = micros();
+    timed = true;
+    resumes++;
+  }
+  wasUp = up;
+  wasSuspended = suspended;
+  if (!up) {
+    return;
+  }
+
+  if (pending) {
+    if (sendAll()) {
+      pending = false;
+      resyncs++;
+      if (timed) {
+        latency.add(micros() - eventUs);
+        timed = false;
+      }
+    }
+  } else if (RESYNC_KEEPALIVE_MS > 0 &&
+             millis() - lastSendMs >= RESYNC_KEEPALIVE_MS) {
+    if (sendAll()) {
+      keepalives++;
+    }
+  }
+}
+
+/**
+ * Sends every report of the image, a section that does not go out stays
+ * dirty and the next poll tries again.
+ */
+bool UsbResync::sendAll() {
+#if JOYSTICK_SIZE == 16
+  usb_joystick_dirty = (1 << JOYSTICK_REPORT_COUNT) - 1;
+#endif
+  if (usb_joystick_send() != 0) {
+    return false;
+  }
+  lastSendMs = millis();
+  return true;
+}
@@ -0,0 +1,94 @@
+/**
+ * Replays a recorded ADC trace through the axis filter of the firmware, to
+ * tune smoothing, deadband and hysteresis without flashing.
+ *
+ *   axisreplay [-r] [-s smoothing] [-d deadband] [-y hysteresis] [trace]
+ *
+ * The trace holds one sample per line, decimated 16 bit sums by default or
+ * single 12 bit conversions with -r, which are summed in blocks of
+ * AXIS_OVERSAMPLE like the DMA buffers are. Every report the device would
+ * send is printed, followed by a summary. The filter starts from the
+ * firmware defaults of axis_filter.h, the options override them.
+ *
+ * tools/captures/throttle.axis is a throttle trace to try it on: the lever
+ * resting near idle, pushed to full, pulled back to about two thirds and
+ * left there, with the noise of the pot and a few spikes.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "axis_filter.h"
+
+namespace {
+
+int usage() {
+  fprintf(stderr, "usage: axisreplay [-r] [-s smoothing] [-d deadband] "
+                  "[-y hysteresis] [trace]\n");
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  bool raw = false;
+  AxisConfig config = AXIS_DEFAULT_CONFIG;
+  int opt;
+  while ((opt = getopt(argc, argv, "rs:d:y:")) != -1) {
+    switch (opt) {
+    case 'r': raw = true; break;
+    case 's': config.smoothing = atoi(optarg); break;
+    case 'd':
+      config.low = atoi(optarg);
+      config.high = 65535 - config.low;
+      break;
+    case 'y': config.hysteresis = atoi(optarg); break;
+    default: return usage();
+    }
+  }
+
+  FILE *in = stdin;
+  if (optind < argc && !(in = fopen(argv[optind], "r"))) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  AxisFilter filter;
+  filter.configure(config);
+  unsigned long samples = 0, reports = 0;
+  unsigned sum = 0, block = 0;
+  bool first = true;
+  char line[64];
+  while (fgets(line, sizeof(line), in)) {
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    unsigned v = strtoul(line, nullptr, 0);
+    if (raw) {
+      sum += v;
+      if (++block < AXIS_OVERSAMPLE) {
+        continue;
+      }
+      v = sum;
+      sum = block = 0;
+    }
+    uint16_t sample = v < 65535 ? v : 65535;
+
+    if (first) {
+      filter.reset(sample);
+      first = false;
+      printf("%8lu %5u %5u %5u start\n", samples, sample, filter.filtered(),
+             filter.output);
+    } else if (filter.update(sample)) {
+      reports++;
+      printf("%8lu %5u %5u %5u\n", samples, sample, filter.filtered(),
+             filter.output);
+    }
+    samples++;
+  }
+
+  printf("%lu samples, %lu reports (%.1f%%)\n", samples, reports,
+         samples ? 100.0 * reports / samples : 0.0);
+  return 0;
+}
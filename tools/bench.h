@@ -0,0 +1,134 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/**
+ * What the host benches of tools/ share: a layout of plain push inputs, a
+ * random source of edges for them, a sink that counts what the pipeline
+ * sends and keep() for kernels whose result goes nowhere. Header only, a
+ * bench links the firmware sources it drives itself.
+ */
+#include <random>
+#include <stdint.h>
+
+#include "layout.h"
+#include "pipeline.h"
+
+/**
+ * Makes the compiler believe value is used, so a kernel whose result goes
+ * nowhere is not optimised away.
+ */
+template <typename T> inline void keep(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * Clears the staging layout and adds inputs push inputs, input i on slot i
+ * as button i + 1. profile picks the debounce profile of a slot, 0 without
+ * one; the caller fills in the profiles and adds what else it needs before
+ * commitLayout().
+ */
+inline void stageInputs(uint8_t inputs, uint8_t flags = 0,
+                        uint8_t button2 = LAYOUT_NO_BUTTON,
+                        uint8_t (*profile)(uint8_t slot) = nullptr) {
+  layout.clearStaging();
+  for (uint8_t i = 0; i < inputs; i++) {
+    layout.add(LayoutEntry{KIND_PUSH, flags, i, LAYOUT_NO_PIN, uint8_t(i + 1),
+                           button2, profile ? profile(i) : uint8_t(0)});
+  }
+}
+
+inline bool commitLayout(uint16_t pulseMs = 20) {
+  layout.seal(pulseMs);
+  return layout.stage() && layout.commit();
+}
+
+// every input released, they are active low
+inline void releaseAll(uint64_t *raw) {
+  for (uint8_t w = 0; w < INPUT_WORDS; w++) {
+    raw[w] = ~0ULL;
+  }
+}
+
+/**
+ * Random edges on the first inputs of word 0, one sample per next(). Every
+ * sample each settled input starts a change with a chance of percent per
+ * 100 samples, then bounces for up to bounce samples before it settles on
+ * its new level. After hold() a pressed input is let go a random number of
+ * samples later instead of by chance, so presses have a length.
+ */
+class EdgeSource {
+public:
+  EdgeSource(std::mt19937 &rng, uint8_t inputs, unsigned percent,
+             unsigned bounce = 0)
+      : rng(rng), inputs(inputs < 64 ? inputs : 64), percent(percent),
+        bounce(bounce), length(0, bounce) {}
+
+  void hold(unsigned minSamples, unsigned maxSamples) {
+    holding = std::uniform_int_distribution<unsigned>(minSamples, maxSamples);
+    holds = true;
+  }
+
+  uint64_t next() {
+    uint64_t before = raw;
+    now++;
+    for (uint8_t i = 0; i < inputs; i++) {
+      uint64_t bit = 1ULL << i;
+      if (bouncing[i]) {
+        bouncing[i]--;
+        raw = bouncing[i] && coin(rng) ? raw ^ bit
+                                       : (raw & ~bit) | (target & bit);
+      } else if (holds && !(target & bit)) {
+        if (now >= releaseAt[i]) {
+          change(i);
+        }
+      } else if (chance(rng) < percent) {
+        change(i);
+        if (holds) {
+          releaseAt[i] = now + holding(rng);
+        }
+      }
+    }
+    edges += __builtin_popcountll(raw ^ before);
+    return raw;
+  }
+
+  uint64_t raw = ~0ULL;     // the last sample, active low
+  unsigned long edges = 0;  // level changes over all samples, bounces too
+
+private:
+  // the first edge already has the new level
+  void change(uint8_t i) {
+    target ^= 1ULL << i;
+    raw ^= 1ULL << i;
+    bouncing[i] = bounce ? length(rng) + 1 : 0;
+  }
+
+  std::mt19937 &rng;
+  uint8_t inputs;
+  unsigned percent;
+  unsigned bounce;
+  std::uniform_int_distribution<unsigned> chance{0, 100 * 100 - 1};
+  std::uniform_int_distribution<unsigned> length;
+  std::uniform_int_distribution<unsigned> coin{0, 1};
+  std::uniform_int_distribution<unsigned> holding;
+  bool holds = false;
+  uint64_t target = ~0ULL;
+  uint32_t now = 0;
+  unsigned bouncing[64] = {};
+  uint32_t releaseAt[64] = {};
+};
+
+/**
+ * Counts what the pipeline sends.
+ */
+class CountingSink : public ButtonSink {
+public:
+  void button(uint8_t, bool pressed) override {
+    (pressed ? presses : releases)++;
+  }
+  void flush() override { flushes++; }
+
+  unsigned long presses = 0, releases = 0, flushes = 0;
+};
+
+#endif // BENCH_H
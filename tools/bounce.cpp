@@ -0,0 +1,184 @@
+/**
+ * Turns a raw edge capture into bounce statistics and debounce windows.
+ *
+ *   bounce [-g gap_ms] [-m margin_percent] [dump]
+ *
+ * The dump is the output of the console commands "capture <slots>" and
+ * "dump", saved to a file, for example with
+ *
+ *   (echo "capture 1 14 17"; sleep 60; echo dump; sleep 2) \
+ *     | picocom -qr -b 115200 /dev/ttyACM0 > bounce.txt
+ *
+ * Edges closer than gap_ms (20 by default) to the previous edge of the same
+ * input belong to one burst, the bounce time of a burst is its first to
+ * last edge. Press and release bursts are counted apart, so the suggested
+ * windows can be asymmetric: the 99th percentile plus a margin, rounded up
+ * to whole milliseconds.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Input {
+  std::string cls = "unknown";
+  unsigned button = 0;
+  bool activeHigh = false;
+  bool seen = false;
+  uint64_t first = 0, last = 0;
+  unsigned edges = 0;
+  uint8_t level = 0;
+};
+
+struct Bursts {
+  std::vector<double> press, release; // bounce time in us
+  unsigned bouncy = 0;                 // bursts with more than one edge
+  unsigned maxEdges = 0;
+};
+
+double percentile(std::vector<double> v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  size_t i = std::min(v.size() - 1, size_t(std::ceil(p * v.size())) - 1);
+  return v[i];
+}
+
+unsigned windowMs(const std::vector<double> &v, unsigned margin) {
+  double us = percentile(v, 0.99) * (100 + margin) / 100;
+  return std::max(1u, unsigned(std::ceil(us / 1000)));
+}
+
+void histogram(const char *name, const std::vector<double> &v) {
+  if (v.empty()) {
+    return;
+  }
+  printf("  %s: %zu bursts, p50 %.0f us, p90 %.0f us, p99 %.0f us, "
+         "max %.0f us\n",
+         name, v.size(), percentile(v, 0.5), percentile(v, 0.9),
+         percentile(v, 0.99), *std::max_element(v.begin(), v.end()));
+  unsigned bins[24] = {};
+  for (double us : v) {
+    unsigned b = us < 1 ? 0 : 1 + unsigned(std::log2(us));
+    bins[std::min(b, 23u)]++;
+  }
+  for (unsigned b = 0; b < 24; b++) {
+    if (bins[b]) {
+      printf("    >= %7u us: %u\n", b ? 1u << (b - 1) : 0, bins[b]);
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double gapMs = 20;
+  unsigned margin = 25;
+  int opt;
+  while ((opt = getopt(argc, argv, "g:m:")) != -1) {
+    switch (opt) {
+    case 'g': gapMs = atof(optarg); break;
+    case 'm': margin = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: bounce [-g gap_ms] [-m margin_percent] [dump]\n");
+      return 2;
+    }
+  }
+  FILE *in = stdin;
+  if (optind < argc && !(in = fopen(argv[optind], "r"))) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  double hz = 600e6;
+  unsigned long lost = 0;
+  std::map<unsigned, Input> inputs;
+  std::map<std::string, Bursts> classes;
+  uint64_t now = 0;
+  uint32_t previous = 0;
+  bool started = false;
+
+  auto close = [&](Input &in) {
+    if (!in.edges) {
+      return;
+    }
+    double us = (in.last - in.first) * 1e6 / hz;
+    Bursts &b = classes[in.cls];
+    bool pressed = in.level == in.activeHigh;
+    (pressed ? b.press : b.release).push_back(us);
+    b.bouncy += in.edges > 1;
+    b.maxEdges = std::max(b.maxEdges, in.edges);
+    in.edges = 0;
+  };
+
+  char line[128];
+  while (fgets(line, sizeof(line), in)) {
+    unsigned long a, b, c;
+    char cls[16];
+    unsigned slot, button, invert;
+    double h;
+    if (sscanf(line, "capture %lu edges, %lu lost, %lf Hz", &a, &lost, &h) ==
+        3) {
+      hz = h;
+    } else if (sscanf(line, "input %u %15s %u %u", &slot, cls, &button,
+                      &invert) == 4) {
+      Input &i = inputs[slot];
+      i.cls = cls;
+      i.button = button;
+      i.activeHigh = invert;
+    } else if (sscanf(line, "edge %lu %lu %lu", &a, &b, &c) == 3) {
+      // the cycle counter wraps every few seconds, the records are in order
+      uint32_t cycles = a;
+      now += started ? uint32_t(cycles - previous) : 0;
+      previous = cycles;
+      started = true;
+
+      Input &i = inputs[b];
+      uint64_t gap = uint64_t(gapMs * hz / 1000);
+      if (i.edges && now - i.last > gap) {
+        close(i);
+      }
+      if (!i.edges) {
+        i.first = now;
+      }
+      i.last = now;
+      i.edges++;
+      i.level = c;
+      i.seen = true;
+    }
+  }
+  for (auto &i : inputs) {
+    close(i.second);
+  }
+
+  if (!started) {
+    fprintf(stderr, "no edges in the dump\n");
+    return 1;
+  }
+  if (lost) {
+    printf("warning: %lu edges were lost to a full buffer\n", lost);
+  }
+  printf("%-8s %6s %6s %8s %10s %12s\n", "class", "bursts", "bouncy",
+         "edges", "press ms", "release ms");
+  for (auto &c : classes) {
+    const Bursts &b = c.second;
+    printf("%-8s %6zu %5.0f%% %8u %10u %12u\n", c.first.c_str(),
+           b.press.size() + b.release.size(),
+           100.0 * b.bouncy / (b.press.size() + b.release.size()), b.maxEdges,
+           windowMs(b.press, margin), windowMs(b.release, margin));
+  }
+  for (auto &c : classes) {
+    printf("%s\n", c.first.c_str());
+    histogram("press", c.second.press);
+    histogram("release", c.second.release);
+  }
+  return 0;
+}
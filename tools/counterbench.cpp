@@ -0,0 +1,127 @@
+/**
+ * Measures what the per-input counters add to a scan of the firmware
+ * pipeline, with all 47 inputs of the default layout switching and
+ * bouncing at random, and checks the counts against the simulation.
+ *
+ *   counterbench [-n scans] [-p press_percent] [-b max_bounce] [-s seed]
+ *
+ * Every scan each input starts a change with the given chance (in percent
+ * per 100 scans), which then bounces for up to max_bounce scans before it
+ * settles. The cost is printed per scan and per edge. Every other input is
+ * eager, which shows in the press latencies printed last.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+#include "bench.h"
+#include "input_counters.h"
+#include "layout.h"
+#include "pipeline.h"
+
+InputCounters inputCounters;
+
+namespace {
+
+const uint8_t INPUTS = 47;
+
+struct Result {
+  double nsPerScan;
+  unsigned long edges;
+};
+
+Result run(bool count, unsigned long scans, unsigned percent, unsigned bounce,
+           unsigned seed) {
+  stageInputs(INPUTS, 0, LAYOUT_NO_BUTTON,
+              [](uint8_t slot) { return uint8_t(slot & 1); });
+  layout.staging().header.debounce[1] = DebounceProfile{0, 0, DEBOUNCE_EAGER};
+  commitLayout();
+
+  CountingSink sink;
+  InputPipeline pipeline(layout, sink);
+  inputCounters = InputCounters();
+  pipeline.setCounters(count ? &inputCounters : nullptr);
+  pipeline.setDebounce(5, 1000);
+
+  std::mt19937 rng(seed);
+  EdgeSource edges(rng, INPUTS, percent, bounce);
+  uint64_t raw[INPUT_WORDS];
+  releaseAll(raw);
+  pipeline.begin(raw);
+
+  // the input sequence is made up front so the timing is the pipeline only
+  std::vector<uint64_t> samples(scans);
+  for (unsigned long n = 0; n < scans; n++) {
+    samples[n] = edges.next();
+  }
+  Result r = {};
+  r.edges = edges.edges;
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long n = 0; n < scans; n++) {
+    pipeline.scan(&samples[n]);
+  }
+  std::chrono::nanoseconds spent = std::chrono::steady_clock::now() - start;
+  r.nsPerScan = double(spent.count()) / scans;
+  return r;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned long scans = 2000000;
+  unsigned percent = 20, bounce = 6, seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:p:b:s:")) != -1) {
+    switch (opt) {
+    case 'n': scans = strtoul(optarg, nullptr, 0); break;
+    case 'p': percent = atoi(optarg); break;
+    case 'b': bounce = atoi(optarg); break;
+    case 's': seed = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: counterbench [-n scans] [-p press_percent] "
+                      "[-b max_bounce] [-s seed]\n");
+      return 2;
+    }
+  }
+
+  Result plain = run(false, scans, percent, bounce, seed);
+  Result counted = run(true, scans, percent, bounce, seed);
+
+  unsigned long edges = 0, flips = 0, presses = 0, rejected = 0;
+  uint8_t longest = 0;
+  for (uint8_t i = 0; i < INPUTS; i++) {
+    const InputCounter &c = inputCounters.slot(i);
+    edges += c.edges;
+    flips += c.flips;
+    presses += c.presses;
+    rejected += c.rejected();
+    longest = c.longest > longest ? c.longest : longest;
+  }
+
+  double extra = counted.nsPerScan - plain.nsPerScan;
+  printf("%u inputs, %lu scans, %lu edges (%.2f per scan)\n", INPUTS, scans,
+         counted.edges, double(counted.edges) / scans);
+  printf("without counters %6.1f ns/scan\n", plain.nsPerScan);
+  printf("with counters    %6.1f ns/scan, %+.1f ns/scan, %.2f ns/edge\n",
+         counted.nsPerScan, extra,
+         counted.edges ? extra * scans / counted.edges : 0.0);
+  printf("counted %lu edges, %lu flips, %lu presses, %lu rejected, longest "
+         "burst %u\n",
+         edges, flips, presses, rejected, longest);
+  const Histogram &eager = inputCounters.eagerLatency;
+  const Histogram &settled = inputCounters.settledLatency;
+  printf("press latency eager %lu-%lu scans, settled %lu-%lu scans\n",
+         (unsigned long)(eager.count ? eager.min : 0),
+         (unsigned long)eager.max,
+         (unsigned long)(settled.count ? settled.min : 0),
+         (unsigned long)settled.max);
+  if (edges != counted.edges) {
+    printf("MISMATCH: the simulation made %lu edges\n", counted.edges);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,202 @@
+/**
+ * Drives the MCP23017 burst reader of src/mcp23017.cpp against a mock I2C
+ * bus and checks that no input change gets lost, however the changes fall
+ * between, into and onto the bursts.
+ *
+ *   expandertest [-n ticks] [-s seed]
+ *
+ * The mock plays up to eight chips with IOCON.SEQOP set: every byte read
+ * returns the port the register pointer is on and toggles the pointer, a
+ * read clears the interrupt of its port and INT is the OR of all of them
+ * (IOCON.MIRROR with an open drain line). Transfers take one to three polls
+ * and some are not acknowledged. Every tick the test flips random inputs,
+ * calls interrupt() on a falling INT as the pin handler does, then poll()
+ * and recheck() as ExpanderPort::poll() does. After every quiet stretch the
+ * words of the chain must equal the levels of the mock. Exits with 1 on a
+ * mismatch.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+
+#include "mcp23017.h"
+
+namespace {
+
+/**
+ * The chips behind the bus, as far as a GPIO burst can tell them apart.
+ */
+class MockBus : public I2cBus {
+public:
+  MockBus(uint8_t chips, unsigned nackPercent, std::mt19937 &rng)
+      : chips(chips), nackPercent(nackPercent), rng(rng) {}
+
+  void startRead(uint8_t address, uint8_t length) override {
+    if (pending) {
+      overlaps++;
+    }
+    pending = true;
+    this->address = address;
+    this->length = length;
+    wait = 1 + rng() % 3;
+  }
+
+  Status poll(uint8_t *data, uint8_t length) override {
+    if (!pending || --wait > 0) {
+      return BUSY;
+    }
+    pending = false;
+    uint8_t c = address - MCP23017_ADDRESS;
+    // an absent chip does not answer, and now and then a present one neither
+    if (c >= chips || length != this->length || rng() % 100 < nackPercent) {
+      nacks++;
+      return FAILED;
+    }
+    for (uint8_t i = 0; i < length; i++) {
+      Chip &ch = chip[c];
+      data[i] = ch.onB ? ch.level >> 8 : ch.level & 0xFF;
+      ch.interrupt &= ch.onB ? 0x00FF : 0xFF00;
+      ch.onB = !ch.onB;
+    }
+    return DONE;
+  }
+
+  void set(uint8_t c, uint8_t pin, bool high) {
+    uint16_t bit = 1 << pin;
+    uint16_t next = high ? chip[c].level | bit : chip[c].level & ~bit;
+    if (next != chip[c].level) {
+      chip[c].level = next;
+      chip[c].interrupt |= bit;
+    }
+  }
+
+  bool asserted() const {
+    bool any = false;
+    for (uint8_t c = 0; c < chips; c++) {
+      any |= chip[c].interrupt != 0;
+    }
+    return any;
+  }
+
+  uint16_t level(uint8_t c) const { return chip[c].level; }
+
+  unsigned long nacks = 0;
+  unsigned long overlaps = 0; // a read started while one was running
+
+private:
+  struct Chip {
+    uint16_t level = 0xFFFF; // pulled up
+    uint16_t interrupt = 0;  // changed since its port was read
+    bool onB = false;        // the pointer was parked on GPIOA
+  };
+
+  Chip chip[MCP23017_MAX_CHIPS];
+  uint8_t chips;
+  unsigned nackPercent;
+  std::mt19937 &rng;
+  bool pending = false;
+  uint8_t address = 0;
+  uint8_t length = 0;
+  unsigned wait = 0;
+};
+
+struct Result {
+  unsigned long changes = 0;
+  unsigned long checks = 0;
+  unsigned long mismatches = 0;
+  unsigned long maxSettle = 0; // ticks from the last change to matching words
+};
+
+Result run(MockBus &bus, ExpanderChain &chain, uint8_t chips,
+           unsigned long ticks, std::mt19937 &rng) {
+  // some inputs are already down at boot, begin() reads them once
+  for (uint8_t c = 0; c < chips; c++) {
+    bus.set(c, rng() % 16, false);
+  }
+  chain.begin(chips);
+  chain.interrupt(0);
+
+  Result r;
+  bool line = bus.asserted();
+  unsigned long quietSince = 0;
+  bool settled = false;
+  for (unsigned long t = 1; t <= ticks; t++) {
+    // busy stretches of up to 40 ticks with a change now and then, then
+    // quiet ones long enough for every burst to finish
+    bool busy = (t / 40) % 3 != 2;
+    if (busy && rng() % 4 == 0) {
+      uint8_t n = 1 + rng() % 3;
+      for (uint8_t k = 0; k < n; k++) {
+        bus.set(rng() % chips, rng() % 16, rng() % 2);
+        r.changes++;
+      }
+      quietSince = t;
+      settled = false;
+    }
+    if (bus.asserted() && !line) {
+      chain.interrupt(t); // the falling edge of INT
+    }
+    line = bus.asserted();
+
+    chain.poll(t);
+    chain.recheck(t, bus.asserted());
+    line = bus.asserted();
+
+    bool match = chain.idle() && !bus.asserted();
+    for (uint8_t c = 0; c < chips && match; c++) {
+      match = chain.word(c) == bus.level(c);
+    }
+    if (match && !settled) {
+      settled = true;
+      r.maxSettle = std::max(r.maxSettle, t - quietSince);
+    }
+    // a quiet stretch is over, everything must have been read by now
+    if (!busy && (t % 40) == 39) {
+      r.checks++;
+      r.mismatches += !match;
+    }
+  }
+  return r;
+}
+
+int usage() {
+  fprintf(stderr, "usage: expandertest [-n ticks] [-s seed]\n");
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned long ticks = 200000;
+  unsigned seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+    switch (opt) {
+    case 'n': ticks = strtoul(optarg, nullptr, 0); break;
+    case 's': seed = strtoul(optarg, nullptr, 0); break;
+    default: return usage();
+    }
+  }
+
+  bool ok = true;
+  printf("chips nack%%  changes  bursts  errors  settle  checks  result\n");
+  for (uint8_t chips : {1, 3, 8}) {
+    for (unsigned nack : {0u, 5u}) {
+      std::mt19937 rng(seed);
+      MockBus bus(chips, nack, rng);
+      ExpanderChain chain(bus);
+      Result r = run(bus, chain, chips, ticks, rng);
+      // a failed read is retried, so every NACK shows up as one error, and
+      // the chain never starts a read while one is running
+      bool good = r.mismatches == 0 && chain.errors == bus.nacks &&
+                  bus.overlaps == 0;
+      ok &= good;
+      printf("%5u %5u %8lu %7lu %7lu %7lu %7lu  %s\n", chips, nack, r.changes,
+             (unsigned long)chain.reads, (unsigned long)chain.errors,
+             r.maxSettle, r.checks, good ? "ok" : "FAILED");
+    }
+  }
+  return ok ? 0 : 1;
+}
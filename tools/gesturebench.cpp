@@ -0,0 +1,108 @@
+/**
+ * Runs the gesture stage of the firmware on the host with all 47 inputs of
+ * the default layout flagged for gestures and every one of them being
+ * pressed at random, to measure what the stage costs per scan and how many
+ * timers it keeps in flight.
+ *
+ *   gesturebench [-n scans] [-p press_percent] [-s seed]
+ *
+ * One scan is one millisecond of wheel time. Each scan every released input
+ * goes down with the given chance (in percent per 100 ms) and is let go
+ * after a random 20 to 1500 ms, so taps, double taps, holds and long
+ * presses all occur.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+
+#include "bench.h"
+#include "deferred.h"
+#include "gestures.h"
+#include "layout.h"
+#include "pipeline.h"
+
+namespace {
+
+const uint8_t INPUTS = 47;
+
+struct Result {
+  double nsPerScan;
+  unsigned long presses;
+  uint8_t peakTimers;
+};
+
+Result run(bool withGestures, unsigned long scans, unsigned percent,
+           unsigned seed) {
+  // every input shares the three gesture ids above its own buttons
+  stageInputs(INPUTS, withGestures ? FLAG_GESTURES : 0, LAYER_MAX_BUTTON - 2);
+  if (!commitLayout()) {
+    fprintf(stderr, "the bench layout does not stage\n");
+    exit(1);
+  }
+
+  CountingSink sink;
+  InputPipeline pipeline(layout, sink);
+  gestures = GestureEngine();
+  gestures.begin(sink, pipeline);
+  pipeline.setGestures(&gestures);
+  pipeline.setDebounce(1, 1000);
+  deferred = Deferred();
+  deferred.begin(0);
+
+  std::mt19937 rng(seed);
+  EdgeSource edges(rng, INPUTS, percent);
+  edges.hold(20, 1500);
+  uint64_t raw[INPUT_WORDS];
+  releaseAll(raw);
+  pipeline.begin(raw);
+
+  Result r = {};
+  std::chrono::nanoseconds spent(0);
+  for (uint32_t now = 1; now <= scans; now++) {
+    raw[0] = edges.next();
+
+    auto start = std::chrono::steady_clock::now();
+    deferred.advance(now);
+    pipeline.scan(raw);
+    spent += std::chrono::steady_clock::now() - start;
+    if (deferred.used() > r.peakTimers) {
+      r.peakTimers = deferred.used();
+    }
+  }
+  r.nsPerScan = double(spent.count()) / scans;
+  r.presses = sink.presses;
+  return r;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned long scans = 1000000;
+  unsigned percent = 5, seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:p:s:")) != -1) {
+    switch (opt) {
+    case 'n': scans = strtoul(optarg, nullptr, 0); break;
+    case 'p': percent = atoi(optarg); break;
+    case 's': seed = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: gesturebench [-n scans] [-p press_percent] "
+                      "[-s seed]\n");
+      return 2;
+    }
+  }
+
+  Result plain = run(false, scans, percent, seed);
+  Result with = run(true, scans, percent, seed);
+  printf("%u inputs, %lu scans, %zu bytes of gesture state\n", INPUTS, scans,
+         sizeof(GestureEngine));
+  printf("without gestures %7.1f ns/scan, %lu presses\n", plain.nsPerScan,
+         plain.presses);
+  printf("with gestures    %7.1f ns/scan, %lu presses, %lu gestures, "
+         "%u timers peak, %lu overflows, %lu pulses dropped\n",
+         with.nsPerScan, with.presses, (unsigned long)gestures.emitted, with.peakTimers,
+         (unsigned long)deferred.overflows, (unsigned long)gestures.dropped);
+  return 0;
+}
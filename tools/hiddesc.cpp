@@ -0,0 +1,286 @@
+/**
+ * Parses joystick report descriptors and prints the layout of every report.
+ *
+ *   hiddesc                    check the descriptors built into the firmware
+ *   hiddesc <descriptor.bin>   dump a descriptor, for example one read from
+ *                              /sys/class/hidraw/hidrawN/device/report_descriptor
+ *
+ * Without arguments the descriptors come straight from
+ * overrides/teensy4/usb_joystick_desc.h and are checked against the report
+ * sizes the firmware sends, the exit status is non zero on a mismatch.
+ */
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace buttons56 {
+#define JOYSTICK_SIZE 7
+#include "usb_joystick_desc.h"
+#undef JOYSTICK_SIZE
+} // namespace buttons56
+
+namespace reportIds {
+#define JOYSTICK_SIZE 16
+#include "usb_joystick_desc.h"
+#undef JOYSTICK_SIZE
+} // namespace reportIds
+
+namespace {
+
+struct Field {
+  uint8_t reportId;
+  uint32_t bitOffset;
+  uint8_t bitSize;
+  uint16_t count;
+  uint16_t usagePage;
+  std::vector<uint32_t> usages; // one per element, 0 = padding
+  bool constant;
+};
+
+struct Parsed {
+  std::vector<Field> fields;
+  std::map<uint8_t, uint32_t> reportBits; // input bits per report id
+  bool usesIds = false;
+  std::string error;
+};
+
+Parsed parse(const uint8_t *p, size_t length) {
+  Parsed out;
+  struct Globals {
+    uint16_t usagePage = 0;
+    uint8_t reportSize = 0;
+    uint16_t reportCount = 0;
+    uint8_t reportId = 0;
+  } g;
+  std::vector<Globals> stack;
+  std::vector<uint32_t> usages;
+  uint32_t usageMin = 0, usageMax = 0;
+  int depth = 0;
+
+  size_t i = 0;
+  while (i < length) {
+    uint8_t prefix = p[i++];
+    if (prefix == 0xFE) { // long item, never used by joysticks
+      if (i + 2 > length) {
+        break;
+      }
+      i += 2 + p[i];
+      continue;
+    }
+    uint8_t size = prefix & 3;
+    if (size == 3) {
+      size = 4;
+    }
+    if (i + size > length) {
+      out.error = "item runs past the end";
+      return out;
+    }
+    uint32_t value = 0;
+    for (uint8_t k = 0; k < size; k++) {
+      value |= uint32_t(p[i + k]) << (8 * k);
+    }
+    i += size;
+
+    uint8_t type = (prefix >> 2) & 3;
+    uint8_t tag = prefix >> 4;
+    if (type == 1) { // global
+      switch (tag) {
+      case 0x0: g.usagePage = value; break;
+      case 0x7: g.reportSize = value; break;
+      case 0x8:
+        g.reportId = value;
+        out.usesIds = true;
+        break;
+      case 0x9: g.reportCount = value; break;
+      case 0xA: stack.push_back(g); break;
+      case 0xB:
+        if (stack.empty()) {
+          out.error = "pop without push";
+          return out;
+        }
+        g = stack.back();
+        stack.pop_back();
+        break;
+      }
+    } else if (type == 2) { // local
+      switch (tag) {
+      case 0x0: usages.push_back(value); break;
+      case 0x1: usageMin = value; break;
+      case 0x2: usageMax = value; break;
+      }
+    } else if (type == 0) { // main
+      if (tag == 0x8) { // input
+        Field f = {g.reportId, out.reportBits[g.reportId], g.reportSize,
+                   g.reportCount, g.usagePage, {}, (value & 1) != 0};
+        for (uint16_t n = 0; n < f.count && !f.constant; n++) {
+          uint32_t u = 0;
+          if (!usages.empty()) {
+            u = usages[n < usages.size() ? n : usages.size() - 1];
+          } else if (usageMax >= usageMin && usageMax) {
+            u = usageMin + n <= usageMax ? usageMin + n : 0;
+          }
+          f.usages.push_back(u);
+        }
+        out.reportBits[g.reportId] += uint32_t(f.bitSize) * f.count;
+        out.fields.push_back(f);
+      } else if (tag == 0xA) {
+        depth++;
+      } else if (tag == 0xC) {
+        depth--;
+      }
+      usages.clear();
+      usageMin = usageMax = 0;
+    }
+  }
+  if (depth != 0) {
+    out.error = "unbalanced collections";
+  }
+  return out;
+}
+
+const char *usageName(uint16_t page, uint32_t usage) {
+  static char buf[24];
+  if (page == 0x01) {
+    switch (usage) {
+    case 0x30: return "X";
+    case 0x31: return "Y";
+    case 0x32: return "Z";
+    case 0x33: return "Rx";
+    case 0x34: return "Ry";
+    case 0x35: return "Rz";
+    case 0x36: return "Slider";
+    case 0x39: return "Hat";
+    }
+  } else if (page == 0x09) {
+    snprintf(buf, sizeof(buf), "Button %u", usage);
+    return buf;
+  }
+  snprintf(buf, sizeof(buf), "%04x:%04x", page, usage);
+  return buf;
+}
+
+void print(const Parsed &d) {
+  for (const auto &r : d.reportBits) {
+    if (d.usesIds) {
+      printf("report %u: %u bytes + id\n", r.first, (r.second + 7) / 8);
+    } else {
+      printf("report: %u bytes\n", (r.second + 7) / 8);
+    }
+    for (const Field &f : d.fields) {
+      if (f.reportId != r.first) {
+        continue;
+      }
+      printf("  bit %4u  %2u x %-3u ", f.bitOffset, f.bitSize, f.count);
+      if (f.constant) {
+        printf("padding\n");
+      } else if (f.bitSize == 1 && f.usages.size() > 1) {
+        printf("%s", usageName(f.usagePage, f.usages.front()));
+        printf(" .. %u\n", f.usages.back());
+      } else {
+        for (size_t n = 0; n < f.usages.size(); n++) {
+          printf("%s%s", n ? ", " : "", usageName(f.usagePage, f.usages[n]));
+        }
+        printf("\n");
+      }
+    }
+  }
+}
+
+unsigned buttons(const Parsed &d) {
+  unsigned n = 0;
+  for (const Field &f : d.fields) {
+    if (f.usagePage == 0x09 && !f.constant) {
+      n += f.count;
+    }
+  }
+  return n;
+}
+
+struct Builtin {
+  const char *name;
+  const uint8_t *desc;
+  size_t length;
+  unsigned endpointSize;
+  unsigned buttons;
+  std::map<uint8_t, unsigned> reportBytes; // what usb_joystick.c sends
+};
+
+bool check(const Builtin &b) {
+  printf("== %s (JOYSTICK_SIZE %u)\n", b.name, b.endpointSize);
+  Parsed d = parse(b.desc, b.length);
+  if (!d.error.empty()) {
+    printf("FAIL: %s\n", d.error.c_str());
+    return false;
+  }
+  print(d);
+
+  bool ok = true;
+  if (buttons(d) != b.buttons) {
+    printf("FAIL: %u buttons, expected %u\n", buttons(d), b.buttons);
+    ok = false;
+  }
+  if (d.reportBits.size() != b.reportBytes.size()) {
+    printf("FAIL: %zu reports, expected %zu\n", d.reportBits.size(),
+           b.reportBytes.size());
+    ok = false;
+  }
+  for (const auto &r : b.reportBytes) {
+    auto it = d.reportBits.find(r.first);
+    unsigned bytes = it == d.reportBits.end() ? 0 : (it->second + 7) / 8;
+    unsigned wire = bytes + (d.usesIds ? 1 : 0);
+    if (bytes != r.second) {
+      printf("FAIL: report %u is %u bytes, firmware sends %u\n", r.first,
+             bytes, r.second);
+      ok = false;
+    } else if (wire > b.endpointSize) {
+      printf("FAIL: report %u needs %u bytes, endpoint has %u\n", r.first,
+             wire, b.endpointSize);
+      ok = false;
+    }
+  }
+  printf("%s\n\n", ok ? "ok" : "mismatch");
+  return ok;
+}
+
+int dumpFile(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  std::vector<uint8_t> desc(4096);
+  desc.resize(fread(desc.data(), 1, desc.size(), f));
+  fclose(f);
+
+  Parsed d = parse(desc.data(), desc.size());
+  print(d);
+  if (!d.error.empty()) {
+    fprintf(stderr, "%s\n", d.error.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    return dumpFile(argv[1]);
+  }
+
+  const Builtin builtins[] = {
+      {"56 buttons", buttons56::joystick_report_desc,
+       sizeof(buttons56::joystick_report_desc), 7, 56, {{0, 7}}},
+      {"report ids", reportIds::joystick_report_desc,
+       sizeof(reportIds::joystick_report_desc), 16, 128,
+       {{1, 8}, {2, 8}, {3, 10}}},
+  };
+  bool ok = true;
+  for (const Builtin &b : builtins) {
+    ok &= check(b);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,224 @@
+/**
+ * Host side of the raw HID telemetry channel (firmware built with the
+ * teensy41_rawhid environment). Linux only, talks to /dev/hidraw* directly.
+ *
+ *   hidtool stats              print counters and the scan time histogram
+ *   hidtool watch              print counters every 100 ms until ^C
+ *   hidtool trace [records]    stream trace records as text, see trace2json
+ *   hidtool load <layout.bin>  send a layout blob (header + entries, layout.h)
+ *
+ * The device node is found by vendor/product id and usage page, or can be
+ * given with -d /dev/hidrawN before the command.
+ */
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/hidraw.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "layout.h"
+#include "layout_store.h"
+#include "telemetry.h"
+
+namespace {
+
+int openDevice(const char *path) {
+  if (path) {
+    return open(path, O_RDWR);
+  }
+  DIR *dir = opendir("/dev");
+  if (!dir) {
+    return -1;
+  }
+  int found = -1;
+  while (dirent *d = readdir(dir)) {
+    if (strncmp(d->d_name, "hidraw", 6) != 0) {
+      continue;
+    }
+    std::string node = std::string("/dev/") + d->d_name;
+    int fd = open(node.c_str(), O_RDWR);
+    if (fd < 0) {
+      continue;
+    }
+    hidraw_devinfo info = {};
+    hidraw_report_descriptor desc = {};
+    int size = 0;
+    bool match = ioctl(fd, HIDIOCGRAWINFO, &info) == 0 &&
+                 (uint16_t)info.vendor == TELEMETRY_VENDOR_ID &&
+                 (uint16_t)info.product == TELEMETRY_PRODUCT_ID &&
+                 ioctl(fd, HIDIOCGRDESCSIZE, &size) == 0;
+    if (match) {
+      desc.size = size;
+      // the raw HID descriptor starts with Usage Page (0x06, lsb, msb)
+      match = ioctl(fd, HIDIOCGRDESC, &desc) == 0 && desc.size >= 3 &&
+              desc.value[0] == 0x06 &&
+              (desc.value[1] | desc.value[2] << 8) == TELEMETRY_USAGE_PAGE;
+    }
+    if (match) {
+      found = fd;
+      break;
+    }
+    close(fd);
+  }
+  closedir(dir);
+  return found;
+}
+
+bool sendPacket(int fd, uint8_t type, const void *payload, uint8_t length) {
+  uint8_t report[1 + TELEMETRY_PACKET_SIZE] = {0}; // report id 0 first
+  TelemetryPacket p = {};
+  p.type = type;
+  p.length = length;
+  memcpy(p.payload, payload, length);
+  memcpy(report + 1, &p, sizeof(p));
+  return write(fd, report, sizeof(report)) == (ssize_t)sizeof(report);
+}
+
+bool readPacket(int fd, TelemetryPacket &p, int timeoutMs) {
+  pollfd pfd = {fd, POLLIN, 0};
+  if (poll(&pfd, 1, timeoutMs) <= 0) {
+    return false;
+  }
+  return read(fd, &p, sizeof(p)) == (ssize_t)sizeof(p);
+}
+
+bool subscribe(int fd, uint8_t streams) {
+  SubscribePayload s = {streams};
+  return sendPacket(fd, TM_SUBSCRIBE, &s, sizeof(s));
+}
+
+void printCounters(const TelemetryPacket &p) {
+  CountersPayload c;
+  memcpy(&c, p.payload, sizeof(c));
+  printf("%10u ms  scans %u  events %u  reports %u  dropped %u\n", c.millis,
+         c.scans, c.events, c.reports, c.dropped);
+}
+
+void printHistogram(const TelemetryPacket &p) {
+  HistogramPayload h;
+  memcpy(&h, p.payload, sizeof(h));
+  for (uint8_t i = 0; i < h.count && i < TELEMETRY_HISTOGRAM_BINS; i++) {
+    uint8_t bin = h.first + i;
+    if (h.bins[i]) {
+      printf("  >= %7u cycles: %u\n", bin ? 1u << (bin - 1) : 0, h.bins[i]);
+    }
+  }
+}
+
+int stats(int fd, bool forever) {
+  subscribe(fd, STREAM_COUNTERS);
+  TelemetryPacket p;
+  bool haveCounters = false;
+  while (readPacket(fd, p, 1000)) {
+    if (p.type == TM_COUNTERS) {
+      if (haveCounters && !forever) {
+        break;
+      }
+      haveCounters = true;
+      printCounters(p);
+    } else if (p.type == TM_HISTOGRAM && !forever) {
+      printHistogram(p);
+    }
+  }
+  subscribe(fd, 0);
+  return haveCounters ? 0 : 1;
+}
+
+int trace(int fd, long limit) {
+  subscribe(fd, STREAM_TRACE);
+  TelemetryPacket p;
+  long seen = 0;
+  while ((limit <= 0 || seen < limit) && readPacket(fd, p, 5000)) {
+    if (p.type != TM_TRACE) {
+      continue;
+    }
+    for (uint8_t off = 0; off + sizeof(TraceRecord) <= p.length;
+         off += sizeof(TraceRecord)) {
+      TraceRecord r;
+      memcpy(&r, p.payload + off, sizeof(r));
+      printf("%u %u %u %u\n", r.cycles, r.event, r.slot, r.arg);
+      seen++;
+    }
+    fflush(stdout);
+  }
+  subscribe(fd, 0);
+  return 0;
+}
+
+int load(int fd, const char *file) {
+  FILE *f = fopen(file, "rb");
+  if (!f) {
+    perror(file);
+    return 1;
+  }
+  std::vector<uint8_t> frame(1, LAYOUT_FRAME_START);
+  uint8_t buf[256];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    frame.insert(frame.end(), buf, buf + n);
+  }
+  fclose(f);
+
+  for (size_t off = 0; off < frame.size(); off += TELEMETRY_PAYLOAD_SIZE) {
+    size_t len = std::min<size_t>(TELEMETRY_PAYLOAD_SIZE, frame.size() - off);
+    if (!sendPacket(fd, TM_LAYOUT, frame.data() + off, len)) {
+      perror("write");
+      return 1;
+    }
+  }
+  TelemetryPacket p;
+  while (readPacket(fd, p, 1000)) {
+    if (p.type == TM_ACK && p.payload[0] == TM_LAYOUT) {
+      printf("layout %s\n", p.payload[1] == 0 ? "accepted" : "rejected");
+      return p.payload[1] == 0 ? 0 : 1;
+    }
+  }
+  fprintf(stderr, "no answer from the device\n");
+  return 1;
+}
+
+int usage() {
+  fprintf(stderr, "usage: hidtool [-d /dev/hidrawN] stats|watch|trace "
+                  "[records]|load <layout.bin>\n");
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *path = nullptr;
+  int arg = 1;
+  if (argc > 2 && strcmp(argv[1], "-d") == 0) {
+    path = argv[2];
+    arg = 3;
+  }
+  if (arg >= argc) {
+    return usage();
+  }
+
+  int fd = openDevice(path);
+  if (fd < 0) {
+    fprintf(stderr, "no button box raw HID interface found\n");
+    return 1;
+  }
+
+  std::string cmd = argv[arg];
+  if (cmd == "stats") {
+    return stats(fd, false);
+  } else if (cmd == "watch") {
+    return stats(fd, true);
+  } else if (cmd == "trace") {
+    return trace(fd, arg + 1 < argc ? atol(argv[arg + 1]) : 0);
+  } else if (cmd == "load" && arg + 1 < argc) {
+    return load(fd, argv[arg + 1]);
+  }
+  return usage();
+}
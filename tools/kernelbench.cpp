@@ -0,0 +1,247 @@
+/**
+ * Times the small kernels every scan and every encoder interrupt run, one
+ * fixture per kernel, so a change to one of them can be judged by numbers:
+ *
+ *   decode    quadrature table step of QuadratureDecoder, per transition
+ *   debounce  PackedDebouncer::update on one word of 64 inputs
+ *   eager     the same with eager inputs and lockout, as the profiles set up
+ *   gather    gatherPorts over 47 inputs on 4 port words, per scan
+ *   pack      the button bit math of Joystick.button(), per button
+ *   lookup    slot to layout button to layer button, per slot
+ *
+ *   kernelbench [-f filter] [-t min_ms] [-r repeats]
+ *
+ * Each fixture is run in batches whose size is doubled until one batch
+ * takes min_ms (20 by default), then timed repeats times (9). Printed are
+ * the median ns/op and ops/s of the repeats, the fastest repeat and the
+ * spread (slowest - fastest) / median; a spread above a few percent means
+ * the machine was busy and the numbers are not worth comparing. Inputs
+ * come from tables made up front and cycled, so every op sees new data and
+ * only the kernel is timed. Run it pinned (taskset -c 2) for steadier
+ * numbers. -f runs only the fixtures whose name contains filter.
+ *
+ * These are host numbers: they rank two versions of a kernel, the cycles
+ * on the Teensy itself come from the tasks job of the profile build.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "bench.h"
+#include "debounce.h"
+#include "gather.h"
+#include "layers.h"
+#include "layout.h"
+#include "quadrature.h"
+
+namespace {
+
+// input tables are cycled with this mask
+const size_t TABLE = 4096;
+const size_t MASK = TABLE - 1;
+
+struct Fixture {
+  const char *name;
+  const char *op;
+  std::function<void(uint64_t)> run; // runs the kernel n times
+};
+
+double timeBatch(const Fixture &f, uint64_t n) {
+  auto start = std::chrono::steady_clock::now();
+  f.run(n);
+  std::chrono::nanoseconds spent = std::chrono::steady_clock::now() - start;
+  return double(spent.count());
+}
+
+std::mt19937 rng(1);
+
+// AB levels of an encoder turned back and forth, valid transitions only
+Fixture decode() {
+  static std::vector<uint8_t> levels(TABLE);
+  const uint8_t GRAY[] = {0x03, 0x02, 0x00, 0x01}; // +1 order from rest
+  unsigned at = 0;
+  int dir = 1;
+  for (size_t i = 0; i < TABLE; i++) {
+    if (rng() % 16 == 0) {
+      dir = -dir;
+    }
+    at = (at + dir) & 3;
+    levels[i] = GRAY[at];
+  }
+  return {"decode", "transition", [](uint64_t n) {
+            static QuadratureDecoder decoder;
+            int32_t detents = 0;
+            for (uint64_t i = 0; i < n; i++) {
+              detents += decoder.update(levels[i & MASK], false);
+            }
+            keep(detents);
+          }};
+}
+
+/**
+ * Samples of 64 inputs where a few change at a time and bounce for a
+ * handful of samples, about what the scan sees while the box is used.
+ */
+std::vector<uint64_t> bouncingWords() {
+  std::vector<uint64_t> words(TABLE);
+  EdgeSource edges(rng, 64, 100, 5);
+  for (uint64_t &w : words) {
+    w = edges.next();
+  }
+  return words;
+}
+
+Fixture debounce(bool eager) {
+  static std::vector<uint64_t> words = bouncingWords();
+  static PackedDebouncer plain, profiled;
+  PackedDebouncer &d = eager ? profiled : plain;
+  d.reset(words[0]);
+  d.setThreshold(~0ULL, 5, 5);
+  if (eager) {
+    // the profiles of src/main.cpp over a word: push, toggles, clicks
+    d.setThreshold(0x00000000FFFF0000ULL, 5, 5);
+    d.setThreshold(0x000000000000FFFEULL, 10, 10);
+    d.setThreshold(0xFFFF000000000000ULL, 5, 10);
+    d.eager = 0xFFFF000000000001ULL;
+    d.setLockout(d.eager, 5);
+  }
+  auto run = [&d](uint64_t n) {
+    uint64_t flips = 0;
+    for (uint64_t i = 0; i < n; i++) {
+      flips ^= d.update(words[i & MASK]);
+    }
+    keep(flips);
+  };
+  return {eager ? "eager" : "debounce", "word", run};
+}
+
+Fixture gather() {
+  const uint8_t INPUTS = 47, PORTS = 4;
+  static GatherEntry table[INPUTS];
+  static std::vector<uint32_t> ports(TABLE * PORTS);
+  // pins are spread over the ports the way the Teensy 4.1 pinout does
+  for (uint8_t i = 0; i < INPUTS; i++) {
+    table[i] = GatherEntry{1u << (rng() % 32), uint8_t(rng() % PORTS), i};
+  }
+  for (uint32_t &w : ports) {
+    w = rng();
+  }
+  return {"gather", "scan", [](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+              uint64_t raw[2] = {};
+              gatherPorts(&ports[(i & MASK) * PORTS], table, INPUTS, raw);
+              keep(raw);
+            }
+          }};
+}
+
+Fixture pack() {
+  static std::vector<uint16_t> changes(TABLE); // id << 1 | pressed
+  for (uint16_t &c : changes) {
+    c = uint16_t((1 + rng() % 56) << 1 | (rng() & 1));
+  }
+  return {"pack", "button", [](uint64_t n) {
+            uint32_t data[2] = {};
+            for (uint64_t i = 0; i < n; i++) {
+              // the bit math of button() in overrides/teensy4/usb_joystick.h,
+              // JOYSTICK_SIZE 7, without the send
+              unsigned num = changes[i & MASK] >> 1;
+              bool val = changes[i & MASK] & 1;
+              if (--num >= 56) {
+                continue;
+              }
+              uint32_t *p = data + (num >> 5);
+              num &= 0x1F;
+              if (val) {
+                *p |= (1 << num);
+              } else {
+                *p &= ~(1 << num);
+              }
+              keep(data);
+            }
+          }};
+}
+
+Fixture lookup() {
+  const uint8_t INPUTS = 47;
+  stageInputs(INPUTS);
+  commitLayout();
+  static std::vector<uint8_t> slots(TABLE), layers(TABLE);
+  for (size_t i = 0; i < TABLE; i++) {
+    slots[i] = rng() % INPUTS;
+    layers[i] = rng() % LAYER_COUNT;
+  }
+  return {"lookup", "slot", [](uint64_t n) {
+            uint32_t sum = 0;
+            for (uint64_t i = 0; i < n; i++) {
+              // InputPipeline::press() and map()
+              uint8_t button = layout.entry(slots[i & MASK]).button;
+              sum += LAYER_MAP.map[layers[i & MASK]][button];
+            }
+            keep(sum);
+          }};
+}
+
+int usage() {
+  fprintf(stderr, "usage: kernelbench [-f filter] [-t min_ms] [-r repeats]\n");
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string filter;
+  double minNs = 20e6;
+  unsigned repeats = 9;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:t:r:")) != -1) {
+    switch (opt) {
+    case 'f': filter = optarg; break;
+    case 't': minNs = atof(optarg) * 1e6; break;
+    case 'r': repeats = strtoul(optarg, nullptr, 0); break;
+    default: return usage();
+    }
+  }
+  if (!repeats) {
+    return usage();
+  }
+
+  std::vector<Fixture> fixtures = {decode(),   debounce(false), debounce(true),
+                                   gather(),   pack(),          lookup()};
+  fixtures.erase(std::remove_if(fixtures.begin(), fixtures.end(),
+                                [&](const Fixture &f) {
+                                  return !strstr(f.name, filter.c_str());
+                                }),
+                 fixtures.end());
+  if (fixtures.empty()) {
+    return usage();
+  }
+
+  printf("kernel    op            ns/op        ops/s   fastest  spread\n");
+  for (const Fixture &f : fixtures) {
+    // grow the batch until it is long enough for the clock, which also
+    // warms the caches and the branch predictor up
+    uint64_t n = 1;
+    while (timeBatch(f, n) < minNs && n < (1ULL << 40)) {
+      n *= 2;
+    }
+    std::vector<double> perOp;
+    for (unsigned r = 0; r < repeats; r++) {
+      perOp.push_back(timeBatch(f, n) / n);
+    }
+    std::sort(perOp.begin(), perOp.end());
+    double median = perOp[perOp.size() / 2];
+    printf("%-9s %-10s %8.3f %12.4g %9.3f %6.1f%%\n", f.name, f.op, median,
+           1e9 / median, perOp.front(),
+           100 * (perOp.back() - perOp.front()) / median);
+    fflush(stdout);
+  }
+  return 0;
+}
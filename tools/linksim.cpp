@@ -0,0 +1,179 @@
+/**
+ * Runs the box to box link codec of the firmware across a pseudo-terminal
+ * pair: a simulated slave encodes a random stream of input changes into
+ * one end, the master side decodes what comes out of the other end and
+ * merges it into a button image, which is checked against the slave.
+ *
+ *   linksim [-n changes] [-e error_ppm] [-b baud] [-s seed]
+ *
+ * With -e bits on the wire are flipped at random; the CRC has to catch
+ * them, and the master has to be back in step by the next full frame. The
+ * wire time of every frame at the given baud rate is checked against the
+ * 1 ms latency budget. The exit status is non zero on any mismatch.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <random>
+#include <termios.h>
+#include <unistd.h>
+
+#include "link.h"
+
+namespace {
+
+class ImageSink : public ButtonSink {
+public:
+  void button(uint8_t id, bool pressed) override {
+    uint8_t n = id - LINK_FIRST;
+    if (pressed) {
+      image[n >> 6] |= 1ULL << (n & 63);
+    } else {
+      image[n >> 6] &= ~(1ULL << (n & 63));
+    }
+  }
+  void flush() override {}
+
+  static const uint8_t LINK_FIRST = 65;
+  uint64_t image[LINK_WORDS] = {};
+};
+
+int openPair(int &reader) {
+  int writer = posix_openpt(O_RDWR | O_NOCTTY);
+  if (writer < 0 || grantpt(writer) || unlockpt(writer)) {
+    perror("posix_openpt");
+    return -1;
+  }
+  reader = open(ptsname(writer), O_RDWR | O_NOCTTY);
+  if (reader < 0) {
+    perror(ptsname(writer));
+    return -1;
+  }
+  termios t;
+  tcgetattr(reader, &t);
+  cfmakeraw(&t);
+  tcsetattr(reader, TCSANOW, &t);
+  return writer;
+}
+
+bool readAll(int fd, uint8_t *data, size_t length) {
+  while (length) {
+    ssize_t n = read(fd, data, length);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    length -= n;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned long changes = 100000, errorPpm = 0, baud = 2000000;
+  unsigned seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:e:b:s:")) != -1) {
+    switch (opt) {
+    case 'n': changes = strtoul(optarg, nullptr, 0); break;
+    case 'e': errorPpm = strtoul(optarg, nullptr, 0); break;
+    case 'b': baud = strtoul(optarg, nullptr, 0); break;
+    case 's': seed = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: linksim [-n changes] [-e error_ppm] [-b baud] "
+                      "[-s seed]\n");
+      return 2;
+    }
+  }
+
+  int reader;
+  int writer = openPair(reader);
+  if (writer < 0) {
+    return 1;
+  }
+
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<unsigned> slot(0, LINK_SLOTS - 1);
+  std::uniform_int_distribution<unsigned> burst(1, 10);
+  std::uniform_int_distribution<unsigned> ppm(0, 999999);
+  std::uniform_int_distribution<unsigned> bit(0, 7);
+
+  LinkEncoder tx;
+  LinkDecoder rx;
+  ImageSink sink;
+  uint64_t state[LINK_WORDS] = {}, merged[LINK_WORDS] = {};
+  unsigned long bytes = 0, corrupted = 0, mismatches = 0, stale = 0;
+  unsigned maxFrame = 0;
+  bool dirty = false; // a corrupted frame since the last full one
+
+  for (unsigned long step = 0; step <= changes; step++) {
+    // a few flips per scan, now and then a full frame like the keyframe
+    unsigned flips = burst(rng) > 8 ? burst(rng) : 1;
+    for (unsigned k = 0; k < flips && step; k++) {
+      unsigned s = slot(rng);
+      state[s >> 6] ^= 1ULL << (s & 63);
+    }
+    bool full = step % 20 == 0 || step == changes;
+
+    uint8_t frame[LINK_MAX_FRAME];
+    uint8_t length = tx.encode(state, frame, full);
+    maxFrame = std::max<unsigned>(maxFrame, length);
+    bool last = step == changes, hit = false;
+    for (uint8_t i = 0; i < length && errorPpm && !last; i++) {
+      if (ppm(rng) < errorPpm * 8) {
+        frame[i] ^= 1 << bit(rng);
+        corrupted++;
+        hit = dirty = true;
+      }
+    }
+    if (write(writer, frame, length) != length) {
+      perror("write");
+      return 1;
+    }
+    bytes += length;
+
+    uint8_t wire[LINK_MAX_FRAME];
+    if (!readAll(reader, wire, length)) {
+      perror("read");
+      return 1;
+    }
+    uint32_t decoded = rx.frames;
+    for (uint8_t i = 0; i < length; i++) {
+      if (rx.feed(wire[i])) {
+        linkMerge(merged, rx.state(), ImageSink::LINK_FIRST, sink);
+        std::copy(rx.state(), rx.state() + LINK_WORDS, merged);
+      }
+    }
+
+    // an intact full frame that the receiver was ready for puts it back in
+    // step, one cut into by a corrupted length field does not
+    if (full && !hit && rx.frames == decoded + 1) {
+      dirty = false;
+    }
+    bool same = std::equal(state, state + LINK_WORDS, sink.image);
+    if (!same && !dirty) {
+      mismatches++;
+    } else if (!same) {
+      stale++;
+    }
+  }
+
+  double usPerByte = 10e6 / baud;
+  printf("%lu changes, %lu frames (%lu full), %lu bytes, %.1f bytes/frame\n",
+         changes, (unsigned long)tx.frames, (unsigned long)tx.fullFrames,
+         bytes, double(bytes) / tx.frames);
+  printf("wire at %lu baud: %.1f us per frame on average, %.1f us worst "
+         "(budget 1000 us)\n",
+         baud, usPerByte * bytes / tx.frames, usPerByte * maxFrame);
+  printf("receiver: %lu frames, %lu crc errors, %lu gaps, %lu junk bytes\n",
+         (unsigned long)rx.frames, (unsigned long)rx.crcErrors,
+         (unsigned long)rx.gaps, (unsigned long)rx.junk);
+  printf("%lu bits corrupted, %lu scans behind after an error, %lu "
+         "mismatches\n",
+         corrupted, stale, mismatches);
+  close(reader);
+  close(writer);
+  return mismatches || usPerByte * maxFrame > 1000 ? 1 : 0;
+}
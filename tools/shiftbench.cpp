@@ -0,0 +1,208 @@
+/**
+ * Feeds a synthetic 74HC165 bit stream through the shift chain sampler of
+ * include/shift_sampler.h, checks that the scan sees every sample bit in
+ * the slot the layout expects, and times the sample and scan side.
+ *
+ *   shiftbench [-n samples] [-s seed]
+ *
+ * The chain is built as the teensy41_shift env builds it, eight chips from
+ * slot 64 on. Every sample a few random inputs change; the inputs are put
+ * on MISO as the chain shifts them out (the chip next to the Teensy first,
+ * D7 first) and clocked into the buffer start() hands out MSB first, the
+ * way SPI_MODE0 with MSBFIRST receives them. Now and then a transfer runs
+ * over the next timer tick, which start() must count as an overrun. Every
+ * fourth sample the scan merges the chain into a level word with holes in
+ * the mask and compares it with the inputs of the last complete sample,
+ * with another check halfway through a transfer that the half written
+ * buffer stays out of sight. Exits with 1 on a mismatch.
+ *
+ * Printed are the ns per sample for clocking in the stream (a host stand in
+ * for the DMA, which costs the Teensy no cycles) and the ns per merge, the
+ * part every scan pays.
+ */
+#define BUTTONBOX_SHIFT_CHIPS 8
+#define LAYOUT_MAX_ENTRIES 128
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+#include "bench.h"
+#include "shift_sampler.h"
+
+namespace {
+
+const int INPUTS = SHIFT_CHIPS * 8;
+
+// scans per sample of the firmware defaults, 1000 us over 250 us
+const int SAMPLES_PER_SCAN = 4;
+
+/**
+ * The bits on MISO for one sample: the chip next to the Teensy shifts out
+ * first and every chip starts with D7.
+ */
+void serialise(const std::vector<bool> &inputs, std::vector<bool> &stream) {
+  stream.clear();
+  for (int chip = 0; chip < SHIFT_CHIPS; chip++) {
+    for (int d = 7; d >= 0; d--) {
+      stream.push_back(inputs[chip * 8 + d]);
+    }
+  }
+}
+
+// receives bits [from, to) of the stream into buffer, MSB first per byte
+void clockIn(const std::vector<bool> &stream, size_t from, size_t to,
+             uint8_t *buffer) {
+  for (size_t b = from; b < to; b++) {
+    uint8_t &byte = buffer[b / 8];
+    uint8_t bit = 0x80 >> (b % 8);
+    byte = stream[b] ? byte | bit : byte & ~bit;
+  }
+}
+
+bool slotLevel(const uint64_t *level, int slot) {
+  return level[slot >> 6] >> (slot & 63) & 1;
+}
+
+int usage() {
+  fprintf(stderr, "usage: shiftbench [-n samples] [-s seed]\n");
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned long samples = 1000000;
+  unsigned seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+    switch (opt) {
+    case 'n': samples = strtoul(optarg, nullptr, 0); break;
+    case 's': seed = strtoul(optarg, nullptr, 0); break;
+    default: return usage();
+    }
+  }
+
+  std::mt19937 rng(seed);
+  ShiftSampler sampler;
+  sampler.begin();
+
+  // a layout with holes: some chain slots are not inputs and keep the level
+  // the rest of the scan gave them
+  uint64_t mask[SHIFT_WORDS] = {};
+  for (int i = 0; i < INPUTS; i++) {
+    if (rng() % 8 != 0) {
+      mask[i / 64] |= 1ULL << (i % 64);
+    }
+  }
+  uint64_t level[INPUT_WORDS];
+  const uint64_t FILL = 0x5A5A5A5A5A5A5A5AULL;
+  for (uint64_t &l : level) {
+    l = FILL;
+  }
+
+  std::vector<bool> inputs(INPUTS, true); // pulled up, released
+  std::vector<bool> complete = inputs;    // inputs of the last done()
+  std::vector<bool> stream;
+  unsigned long mismatches = 0, expectedOverruns = 0, merges = 0;
+  uint8_t *pending = nullptr;
+
+  // merges and compares with the last complete sample
+  auto scan = [&]() {
+    sampler.merge(level, mask);
+    merges++;
+    for (int i = 0; i < INPUTS; i++) {
+      int slot = SHIFT_FIRST_SLOT + i;
+      bool used = mask[i / 64] >> (i % 64) & 1;
+      bool want = used ? complete[i] : (FILL >> (slot & 63) & 1);
+      mismatches += slotLevel(level, slot) != want;
+    }
+  };
+
+  for (unsigned long n = 0; n < samples; n++) {
+    // a transfer left running from the last tick finishes now
+    if (pending) {
+      clockIn(stream, stream.size() / 2, stream.size(), pending);
+      sampler.done();
+      complete = inputs;
+      pending = nullptr;
+    }
+
+    for (int k = rng() % 4; k > 0; k--) {
+      int i = rng() % INPUTS;
+      inputs[i] = !inputs[i];
+    }
+    uint8_t *buffer = sampler.start();
+    if (!buffer) {
+      mismatches++; // nothing was running
+      continue;
+    }
+    serialise(inputs, stream);
+    clockIn(stream, 0, stream.size() / 2, buffer);
+    if (n % 16 == 0) {
+      scan(); // mid transfer, must still see the last sample
+    }
+
+    // one transfer in 64 overruns the next tick
+    if (rng() % 64 == 0) {
+      pending = buffer;
+      if (sampler.start()) {
+        mismatches++;
+      }
+      expectedOverruns++;
+    } else {
+      clockIn(stream, stream.size() / 2, stream.size(), buffer);
+      sampler.done();
+      complete = inputs;
+    }
+    if (n % SAMPLES_PER_SCAN == 0) {
+      scan();
+    }
+  }
+  if (pending) {
+    clockIn(stream, stream.size() / 2, stream.size(), pending);
+    sampler.done();
+    complete = inputs;
+  }
+  scan();
+
+  bool ok = mismatches == 0 && sampler.overruns == expectedOverruns;
+  printf("%d chips, %lu samples, %lu scans, %lu overruns, %lu mismatches: "
+         "%s\n",
+         SHIFT_CHIPS, (unsigned long)sampler.samples, merges,
+         (unsigned long)sampler.overruns, mismatches, ok ? "ok" : "FAILED");
+
+  // throughput, on fresh random streams made up front
+  const size_t TABLE = 256;
+  std::vector<std::vector<bool>> streams(TABLE);
+  for (auto &s : streams) {
+    for (int i = 0; i < INPUTS; i++) {
+      inputs[i] = rng() % 2;
+    }
+    serialise(inputs, s);
+  }
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point t0 = Clock::now();
+  for (unsigned long n = 0; n < samples; n++) {
+    uint8_t *buffer = sampler.start();
+    clockIn(streams[n % TABLE], 0, INPUTS, buffer);
+    sampler.done();
+  }
+  Clock::time_point t1 = Clock::now();
+  for (unsigned long n = 0; n < samples; n++) {
+    sampler.merge(level, mask);
+    keep(level);
+  }
+  Clock::time_point t2 = Clock::now();
+  double sampleNs =
+      std::chrono::duration<double, std::nano>(t1 - t0).count() / samples;
+  double mergeNs =
+      std::chrono::duration<double, std::nano>(t2 - t1).count() / samples;
+  printf("sample %.1f ns (%.0f Mbit/s), merge %.2f ns\n", sampleNs,
+         INPUTS * 1e3 / sampleNs, mergeNs);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+/**
+ * Converts trace records into Chrome trace event JSON, to follow a press
+ * from the first contact edge to the report on a timeline in
+ * chrome://tracing or ui.perfetto.dev.
+ *
+ *   hidtool trace > trace.txt
+ *   trace2json [-c mhz] [trace.txt] > trace.json
+ *
+ * Every input slot gets a track with its raw edges and a debounce slice from
+ * the first edge to the debounced change, which is linked by a flow arrow to
+ * the report that carried it. Buttons, reports and timer fires have tracks
+ * of their own. The cycle counter is unwrapped record by record and
+ * converted with the rate of the clock records, or -c (600 MHz) before the
+ * first one. A record a little older than the one before it was appended
+ * late, it goes back on the timeline rather than a whole wrap forward, and
+ * a change traced after its report still gets its arrow.
+ *
+ * tools/captures/press.trace is a bounced press and its release across a
+ * counter wrap to try it on: one debounce slice of 7 ms with 3 edges and
+ * one of 5 ms, each with a flow arrow to its report.
+ */
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "telemetry.h"
+
+namespace {
+
+const int PID = 1;
+const int TID_REPORT = 1;
+const int TID_TIMERS = 2;
+const int TID_SLOTS = 100; // slot n is TID_SLOTS + n
+
+// a change goes out with the report of its own scan or not at all, a change
+// that made no report (a held back chord key, say) must not grab a later one
+const double FLOW_MAX_US = 100;
+
+struct Pending {
+  bool open = false;
+  double start = 0; // us of the first edge of the running change
+  unsigned edges = 0;
+};
+
+bool first = true;
+
+void event(const char *ph, double ts, const std::string &rest) {
+  printf("%s\n    {\"ph\": \"%s\", \"ts\": %.3f, \"pid\": %d, %s}",
+         first ? "" : ",", ph, ts, PID, rest.c_str());
+  first = false;
+}
+
+std::string format(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+std::string format(const char *fmt, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  return buf;
+}
+
+void threadName(int tid, const std::string &name) {
+  event("M", 0,
+        format("\"tid\": %d, \"name\": \"thread_name\", "
+               "\"args\": {\"name\": \"%s\"}",
+               tid, name.c_str()));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double mhz = 600;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:")) != -1) {
+    switch (opt) {
+    case 'c': mhz = atof(optarg); break;
+    default:
+      fprintf(stderr, "usage: trace2json [-c mhz] [trace.txt]\n");
+      return 2;
+    }
+  }
+  FILE *in = stdin;
+  if (optind < argc && !(in = fopen(argv[optind], "r"))) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  printf("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+  event("M", 0,
+        "\"tid\": 0, \"name\": \"process_name\", "
+        "\"args\": {\"name\": \"buttonbox\"}");
+  threadName(TID_REPORT, "report");
+  threadName(TID_TIMERS, "timers");
+
+  std::map<unsigned, Pending> pending;
+  std::set<unsigned> named;
+  std::vector<std::pair<unsigned, double>> flows; // changes and their time
+  unsigned nextFlow = 1;
+  double lastReport = -1; // us of the last report, for late changes
+  unsigned long records = 0, unknown = 0;
+  uint64_t cycles = 0;
+  uint32_t previous = 0;
+  char line[128];
+  while (fgets(line, sizeof(line), in)) {
+    unsigned long raw;
+    unsigned type, slot, arg;
+    if (sscanf(line, "%lu %u %u %u", &raw, &type, &slot, &arg) != 4) {
+      continue;
+    }
+    // records are closer than half a wrap, see TRACE_CLOCK, so a step
+    // back is a late record and not a wrap
+    cycles += records ? int32_t(raw - previous) : 0;
+    previous = raw;
+    records++;
+    double ts = cycles / mhz;
+    int tid = TID_SLOTS + slot;
+
+    switch (type) {
+    case TRACE_CLOCK:
+      if (arg) {
+        // everything so far was converted at the old rate, keep it aligned
+        double us = ts;
+        mhz = arg;
+        cycles = uint64_t(us * mhz);
+      }
+      break;
+
+    case TRACE_EDGE: {
+      if (named.insert(slot).second) {
+        threadName(tid, format("slot %u", slot));
+      }
+      Pending &p = pending[slot];
+      if (!p.open) {
+        p = Pending{true, ts, 0};
+      }
+      p.edges++;
+      event("i", ts,
+            format("\"tid\": %d, \"s\": \"t\", \"name\": \"edge\", "
+                   "\"args\": {\"level\": %u}",
+                   tid, arg));
+      break;
+    }
+
+    case TRACE_ACCEPT: {
+      if (named.insert(slot).second) {
+        threadName(tid, format("slot %u", slot));
+      }
+      Pending &p = pending[slot];
+      double start = p.open ? p.start : ts;
+      const char *name = arg ? "press" : "release";
+      event("X", start,
+            format("\"tid\": %d, \"dur\": %.3f, \"name\": \"%s\", "
+                   "\"args\": {\"edges\": %u}",
+                   tid, ts - start, name, p.edges));
+      event("s", start,
+            format("\"tid\": %d, \"id\": %u, \"cat\": \"pipeline\", "
+                   "\"name\": \"change\"",
+                   tid, nextFlow));
+      if (lastReport >= ts && lastReport - ts <= FLOW_MAX_US) {
+        // appended after the report that carried it
+        event("f", lastReport,
+              format("\"tid\": %d, \"id\": %u, \"bp\": \"e\", "
+                     "\"cat\": \"pipeline\", \"name\": \"change\"",
+                     TID_REPORT, nextFlow++));
+      } else {
+        flows.push_back({nextFlow++, ts});
+      }
+      p.open = false;
+      break;
+    }
+
+    case TRACE_BUTTON:
+      event("i", ts,
+            format("\"tid\": %d, \"s\": \"t\", \"name\": \"button %u %s\"",
+                   TID_REPORT, slot, arg ? "down" : "up"));
+      break;
+
+    case TRACE_REPORT:
+      // a short slice, flow arrows only end on slices
+      event("X", ts,
+            format("\"tid\": %d, \"dur\": 0.1, \"name\": \"usb send\", "
+                   "\"args\": {\"reports\": %u}",
+                   TID_REPORT, arg));
+      for (auto &f : flows) {
+        if (ts - f.second <= FLOW_MAX_US) {
+          event("f", ts,
+                format("\"tid\": %d, \"id\": %u, \"bp\": \"e\", "
+                       "\"cat\": \"pipeline\", \"name\": \"change\"",
+                       TID_REPORT, f.first));
+        }
+      }
+      flows.clear();
+      lastReport = ts;
+      break;
+
+    case TRACE_TIMER:
+      event("i", ts,
+            format("\"tid\": %d, \"s\": \"t\", \"name\": \"timers\", "
+                   "\"args\": {\"fired\": %u}",
+                   TID_TIMERS, arg));
+      break;
+
+    default:
+      unknown++;
+      break;
+    }
+  }
+  printf("\n  ],\n  \"otherData\": {\"clock_mhz\": %.0f, "
+         "\"records\": %lu}\n}\n",
+         mhz, records);
+  if (unknown) {
+    fprintf(stderr, "%lu records of unknown events skipped\n", unknown);
+  }
+  return records ? 0 : 1;
+}
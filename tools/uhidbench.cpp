@@ -0,0 +1,527 @@
+/**
+ * Edge to evdev latency of the input pipeline, measured through the kernel.
+ * Synthetic edge patterns run in real time through the host build of the
+ * pipeline and the encoder pulse trains, the reports go into a uhid device
+ * with the 56 button descriptor, and the evdev events coming back are
+ * matched to the edges that caused them. Linux only, needs write access to
+ * /dev/uhid and read access to the event node it creates (root, usually).
+ *
+ *   uhidbench [-n] [-s scenario] [-S scan_us]
+ *
+ * Scenarios: single, roll10, toggle, encoder10, encoder50, encoder200 and
+ * flap (every input flapping at once). Each prints one JSON object per line
+ * with the expected and received events, the lost and unexpected ones and
+ * the p50/p99/max latency in us from the first edge of a change to its
+ * event. With -n no uhid device is made and a change counts as delivered
+ * when its report is written, which leaves the pipeline alone.
+ *
+ * Encoder detents come out as pulses of 20 ms, and a step that waited in
+ * the queue another 20 ms apart, so a fast spin fills the step queue: the
+ * latency then includes the time a step waited in it and the steps beyond
+ * its ENCODER_MAX_QUEUED count as lost. The layout has no fast buttons, so
+ * every detent plays on the encoder buttons.
+ *
+ * The layout mirrors the input classes of src/main.cpp, which only builds
+ * for the Teensy itself, with the debounce profiles of debounce_profiles.h,
+ * and the encoder steps go through the pulse trains of pulse_train.h.
+ */
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "debounce_profiles.h"
+#include "deferred.h"
+#include "layout.h"
+#include "pipeline.h"
+#include "pulse_train.h"
+#include "quadrature.h"
+
+namespace desc {
+#define JOYSTICK_SIZE 7
+#include "usb_joystick_desc.h"
+#undef JOYSTICK_SIZE
+} // namespace desc
+
+namespace {
+
+// slots of the bench layout, button id = slot + 1
+const uint8_t PUSH = 0;
+const uint8_t TOGGLES = 1;  // 10 poles
+const uint8_t MATRIX = 11;  // 15 keys
+const uint8_t CLICKS = 26;  // 7 encoder clicks
+const uint8_t INPUTS = 33;
+const uint8_t ENCODER = 33; // the encoder entry, after the inputs
+const uint8_t ENCODER_RIGHT = 50;
+const uint8_t ENCODER_LEFT = 51;
+
+const char *const DEVICE_NAME = "buttonbox uhidbench";
+
+double nowUs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * One stimulus: an input slot going to a level or the encoder contacts
+ * going to new AB levels. A stimulus that starts a logical change says
+ * which button event it should end up as.
+ */
+struct Stim {
+  double us; // from the start of the run
+  bool encoder;
+  uint8_t slot; // or the AB levels
+  uint8_t level;
+  uint8_t button; // 0 = no event expected
+  bool pressed;
+};
+
+struct Scenario {
+  std::string name;
+  std::vector<Stim> stims;
+};
+
+/**
+ * A change of an input with its contact bounce: the first edge already
+ * has the new level, then it falls back and returns bounces times, 300 us
+ * apart.
+ */
+void change(std::vector<Stim> &s, double us, uint8_t slot, bool pressed,
+            unsigned bounces) {
+  uint8_t level = pressed ? 0 : 1; // active low
+  s.push_back({us, false, slot, level, uint8_t(slot + 1), pressed});
+  for (unsigned k = 1; k <= 2 * bounces; k++) {
+    s.push_back({us + 300 * k, false, slot, uint8_t(level ^ (k & 1)), 0, 0});
+  }
+}
+
+void press(std::vector<Stim> &s, double us, uint8_t slot, double holdMs,
+           unsigned bounces) {
+  change(s, us, slot, true, bounces);
+  change(s, us + holdMs * 1000, slot, false, bounces);
+}
+
+std::vector<Scenario> scenarios() {
+  std::vector<Scenario> all;
+  std::mt19937 rng(1);
+
+  Scenario single{"single", {}};
+  for (int k = 0; k < 20; k++) {
+    press(single.stims, 10000 + k * 200000.0, PUSH, 80, 2);
+  }
+  all.push_back(single);
+
+  // ten keys rolled one after the other, each down before the last is up
+  Scenario roll{"roll10", {}};
+  for (int rep = 0; rep < 10; rep++) {
+    for (int i = 0; i < 10; i++) {
+      press(roll.stims, 10000 + rep * 250000.0 + i * 12000.0,
+            uint8_t(MATRIX + i), 60, 1);
+    }
+  }
+  all.push_back(roll);
+
+  Scenario toggle{"toggle", {}};
+  for (int k = 0; k < 20; k++) {
+    change(toggle.stims, 10000 + k * 150000.0, TOGGLES, !(k & 1), 3);
+  }
+  all.push_back(toggle);
+
+  // one full quadrature cycle per detent, A leading, back at rest last
+  const uint8_t CYCLE[] = {0x02, 0x00, 0x01, QUAD_REST};
+  for (unsigned rate : {10u, 50u, 200u}) {
+    Scenario spin{"encoder" + std::to_string(rate), {}};
+    double period = 1e6 / rate;
+    unsigned detents = std::max(20u, rate);
+    for (unsigned d = 0; d < detents; d++) {
+      for (int k = 0; k < 4; k++) {
+        spin.stims.push_back({10000 + d * period + k * period / 4, true,
+                              CYCLE[k], 0, uint8_t(k == 3 ? ENCODER_RIGHT : 0),
+                              true});
+      }
+    }
+    all.push_back(spin);
+  }
+
+  // every input changes after 20 to 80 ms, longer than any debounce window
+  Scenario flap{"flap", {}};
+  std::uniform_real_distribution<double> stable(20000, 80000);
+  for (uint8_t slot = 0; slot < INPUTS; slot++) {
+    bool down = false;
+    double us = 10000 + stable(rng);
+    for (; us < 2e6 || down; us += stable(rng)) {
+      down = !down;
+      change(flap.stims, us, slot, down, 1);
+    }
+  }
+  all.push_back(flap);
+
+  for (Scenario &s : all) {
+    std::stable_sort(s.stims.begin(), s.stims.end(),
+                     [](const Stim &a, const Stim &b) { return a.us < b.us; });
+  }
+  return all;
+}
+
+/**
+ * The uhid device and the evdev node the kernel makes for it.
+ */
+class Uhid {
+public:
+  ~Uhid() {
+    if (fd >= 0) {
+      uhid_event ev = {};
+      ev.type = UHID_DESTROY;
+      write(fd, &ev, sizeof(ev));
+      close(fd);
+    }
+    if (evfd >= 0) {
+      close(evfd);
+    }
+  }
+
+  bool create() {
+    if ((fd = open("/dev/uhid", O_RDWR | O_CLOEXEC | O_NONBLOCK)) < 0) {
+      perror("/dev/uhid");
+      return false;
+    }
+    uhid_event ev = {};
+    ev.type = UHID_CREATE2;
+    uhid_create2_req &c = ev.u.create2;
+    snprintf((char *)c.name, sizeof(c.name), "%s", DEVICE_NAME);
+    c.rd_size = sizeof(desc::joystick_report_desc);
+    c.bus = BUS_VIRTUAL;
+    c.vendor = 0x16C0;
+    c.product = 0x0487;
+    memcpy(c.rd_data, desc::joystick_report_desc, c.rd_size);
+    if (write(fd, &ev, sizeof(ev)) != sizeof(ev)) {
+      perror("UHID_CREATE2");
+      return false;
+    }
+    return openEvdev();
+  }
+
+  bool send(const uint8_t *report, size_t size) {
+    uhid_event ev = {};
+    ev.type = UHID_INPUT2;
+    ev.u.input2.size = size;
+    memcpy(ev.u.input2.data, report, size);
+    return write(fd, &ev, sizeof(ev)) == sizeof(ev);
+  }
+
+  // answers what the kernel asks, nothing here has reports to give
+  void service() {
+    uhid_event ev;
+    while (read(fd, &ev, sizeof(ev)) > 0) {
+      if (ev.type == UHID_GET_REPORT) {
+        uhid_event reply = {};
+        reply.type = UHID_GET_REPORT_REPLY;
+        reply.u.get_report_reply.id = ev.u.get_report.id;
+        reply.u.get_report_reply.err = EIO;
+        write(fd, &reply, sizeof(reply));
+      }
+    }
+  }
+
+  int fd = -1;
+  int evfd = -1;
+  std::map<uint16_t, uint8_t> buttons; // key code -> button id
+
+private:
+  bool openEvdev() {
+    // the node shows up a little after the create
+    for (int attempt = 0; attempt < 300; attempt++) {
+      for (int n = 0; n < 64; n++) {
+        std::string path = "/dev/input/event" + std::to_string(n);
+        int f = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (f < 0) {
+          continue;
+        }
+        char name[128] = {};
+        ioctl(f, EVIOCGNAME(sizeof(name) - 1), name);
+        if (strcmp(name, DEVICE_NAME) == 0) {
+          evfd = f;
+          mapButtons();
+          return true;
+        }
+        close(f);
+      }
+      usleep(10000);
+    }
+    fprintf(stderr, "no event node for the uhid device\n");
+    return false;
+  }
+
+  /**
+   * hid-input hands out key codes in button order, so the n-th key the node
+   * supports is button n.
+   */
+  void mapButtons() {
+    int clock = CLOCK_MONOTONIC;
+    ioctl(evfd, EVIOCSCLOCKID, &clock);
+    uint8_t bits[KEY_MAX / 8 + 1] = {};
+    ioctl(evfd, EVIOCGBIT(EV_KEY, sizeof(bits)), bits);
+    uint8_t button = 1;
+    for (unsigned code = 0; code <= KEY_MAX; code++) {
+      if ((bits[code / 8] >> (code % 8)) & 1) {
+        buttons[code] = button++;
+      }
+    }
+  }
+};
+
+struct Delivered {
+  double us;
+  uint8_t button;
+  bool pressed;
+};
+
+/**
+ * Packs button changes into the 7 byte report and hands it to uhid on
+ * flush, or in a dry run counts the report as delivered right away.
+ */
+class ReportSink : public ButtonSink {
+public:
+  explicit ReportSink(Uhid *uhid) : uhid(uhid) {}
+
+  void button(uint8_t id, bool pressed) override {
+    if (id < 1 || id > 56) {
+      return;
+    }
+    uint8_t bit = 1 << ((id - 1) & 7);
+    report[(id - 1) >> 3] = pressed ? report[(id - 1) >> 3] | bit
+                                    : report[(id - 1) >> 3] & ~bit;
+  }
+
+  void flush() override {
+    if (memcmp(report, sent, sizeof(report)) == 0) {
+      return;
+    }
+    if (uhid) {
+      uhid->send(report, sizeof(report));
+    } else {
+      double us = nowUs();
+      for (uint8_t id = 1; id <= 56; id++) {
+        bool was = (sent[(id - 1) >> 3] >> ((id - 1) & 7)) & 1;
+        bool is = (report[(id - 1) >> 3] >> ((id - 1) & 7)) & 1;
+        if (was != is) {
+          delivered.push_back({us, id, is});
+        }
+      }
+    }
+    memcpy(sent, report, sizeof(report));
+    reports++;
+  }
+
+  std::vector<Delivered> delivered;
+  unsigned long reports = 0;
+
+private:
+  Uhid *uhid;
+  uint8_t report[7] = {};
+  uint8_t sent[7] = {};
+};
+
+uint8_t profile(uint8_t slot) {
+  return slot == PUSH      ? PROFILE_PUSH
+         : slot < MATRIX   ? PROFILE_TOGGLE
+         : slot < CLICKS   ? PROFILE_MATRIX
+                           : PROFILE_CLICK;
+}
+
+void buildLayout() {
+  stageInputs(INPUTS, 0, LAYOUT_NO_BUTTON, profile);
+  layout.add(LayoutEntry{KIND_ENCODER, 0, LAYOUT_NO_PIN, LAYOUT_NO_PIN,
+                         ENCODER_RIGHT, ENCODER_LEFT, 0});
+  memcpy(layout.staging().header.debounce, DEBOUNCE_PROFILES,
+         sizeof(DEBOUNCE_PROFILES));
+  commitLayout(ENCODER_PULSE_MS);
+}
+
+double percentile(std::vector<double> v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, size_t(std::ceil(p * v.size())) - 1)];
+}
+
+void sleepUntil(double us, Uhid *uhid) {
+  double left = us - nowUs();
+  if (left <= 0) {
+    return;
+  }
+  timespec ts = {time_t(left / 1e6), long(std::fmod(left, 1e6) * 1000)};
+  if (uhid) {
+    // wake early for the kernel, the caller sleeps again
+    pollfd fds[2] = {{uhid->fd, POLLIN, 0}, {uhid->evfd, POLLIN, 0}};
+    ppoll(fds, 1, &ts, nullptr);
+    uhid->service();
+  } else {
+    nanosleep(&ts, nullptr);
+  }
+}
+
+void readEvents(Uhid *uhid, std::vector<Delivered> &out) {
+  input_event ev[64];
+  ssize_t n;
+  while ((n = read(uhid->evfd, ev, sizeof(ev))) > 0) {
+    for (ssize_t i = 0; i < n / ssize_t(sizeof(input_event)); i++) {
+      auto it = uhid->buttons.find(ev[i].code);
+      if (ev[i].type == EV_KEY && it != uhid->buttons.end()) {
+        out.push_back({ev[i].input_event_sec * 1e6 + ev[i].input_event_usec,
+                       it->second, ev[i].value != 0});
+      }
+    }
+  }
+}
+
+void run(const Scenario &s, Uhid *uhid, uint32_t scanUs) {
+  buildLayout();
+  ReportSink sink(uhid);
+  InputPipeline pipeline(layout, sink);
+  pulseTrains = PulseTrains();
+  pulseTrains.begin(sink, pipeline);
+  pulseTrains.attach(0, ENCODER);
+  pipeline.setDebounce(DEBOUNCE_MS, scanUs);
+  deferred = Deferred();
+  QuadratureDecoder decoder;
+  DetentFilter filter;
+
+  uint64_t raw[INPUT_WORDS];
+  releaseAll(raw);
+  pipeline.begin(raw);
+  std::vector<Delivered> events;
+
+  double start = nowUs();
+  deferred.begin(0);
+  std::map<std::pair<uint8_t, bool>, std::deque<double>> expected;
+  unsigned long expectedCount = 0;
+  size_t next = 0;
+  double tick = start + scanUs;
+  double end = start + (s.stims.empty() ? 0 : s.stims.back().us) + 100000;
+  // a full queue of encoder steps takes two pulses per step to drain
+  end += ENCODER_MAX_QUEUED * 2 * ENCODER_PULSE_MS * 1000.0;
+
+  while (nowUs() < end) {
+    double due = next < s.stims.size() ? start + s.stims[next].us : end;
+    sleepUntil(std::min(due, tick), uhid);
+    double now = nowUs();
+    for (; next < s.stims.size() && start + s.stims[next].us <= now; next++) {
+      const Stim &st = s.stims[next];
+      if (st.button) {
+        expected[{st.button, st.pressed}].push_back(start + st.us);
+        expectedCount++;
+      }
+      if (st.encoder) {
+        // what the pin interrupt does
+        uint32_t t = uint32_t(st.us);
+        filter.transition(t);
+        int8_t dir = decoder.update(st.slot, false);
+        if (dir && filter.accept(dir, t)) {
+          filter.detent(dir, t);
+          pulseTrains.step(0, dir);
+        }
+      } else {
+        uint64_t bit = 1ULL << (st.slot & 63);
+        raw[st.slot >> 6] = st.level ? raw[st.slot >> 6] | bit
+                                     : raw[st.slot >> 6] & ~bit;
+      }
+    }
+    if (now >= tick) {
+      deferred.advance(uint32_t((now - start) / 1000));
+      pipeline.scan(raw);
+      tick += scanUs;
+    }
+    if (uhid) {
+      readEvents(uhid, events);
+    }
+  }
+  if (!uhid) {
+    events = sink.delivered;
+  }
+
+  // every event takes the oldest change of its button it can stand for
+  std::vector<double> latency;
+  unsigned long unexpected = 0;
+  for (const Delivered &d : events) {
+    std::deque<double> &q = expected[{d.button, d.pressed}];
+    if (q.empty() || q.front() > d.us) {
+      // encoder releases end a pulse, they are not a change of their own
+      unexpected += !(d.button >= ENCODER_RIGHT && !d.pressed);
+      continue;
+    }
+    latency.push_back(d.us - q.front());
+    q.pop_front();
+  }
+  unsigned long lost = 0;
+  for (const auto &q : expected) {
+    lost += q.second.size();
+  }
+  printf("{\"scenario\": \"%s\", \"expected\": %lu, \"received\": %zu, "
+         "\"lost\": %lu, \"unexpected\": %lu, \"reports\": %lu, "
+         "\"p50_us\": %.0f, \"p99_us\": %.0f, \"max_us\": %.0f}\n",
+         s.name.c_str(), expectedCount, latency.size(), lost, unexpected,
+         sink.reports, percentile(latency, 0.5), percentile(latency, 0.99),
+         latency.empty() ? 0.0 : *std::max_element(latency.begin(),
+                                                   latency.end()));
+  fflush(stdout);
+}
+
+int usage() {
+  fprintf(stderr, "usage: uhidbench [-n] [-s scenario] [-S scan_us]\n");
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  bool dry = false;
+  std::string only;
+  uint32_t scanUs = 1000;
+  int opt;
+  while ((opt = getopt(argc, argv, "ns:S:")) != -1) {
+    switch (opt) {
+    case 'n': dry = true; break;
+    case 's': only = optarg; break;
+    case 'S': scanUs = strtoul(optarg, nullptr, 0); break;
+    default: return usage();
+    }
+  }
+
+  std::vector<Scenario> runs;
+  for (const Scenario &s : scenarios()) {
+    if (only.empty() || only == s.name) {
+      runs.push_back(s);
+    }
+  }
+  if (runs.empty() || !scanUs) {
+    return usage();
+  }
+
+  Uhid uhid;
+  if (!dry && !uhid.create()) {
+    fprintf(stderr, "run as root, or with -n to leave the kernel out\n");
+    return 1;
+  }
+  for (const Scenario &s : runs) {
+    run(s, dry ? nullptr : &uhid, scanUs);
+  }
+  return 0;
+}
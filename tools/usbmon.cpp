@@ -0,0 +1,332 @@
+/**
+ * Reads a saved usbmon capture of the box and reports how its joystick
+ * reports arrived: the interval between reports, how long every button was
+ * held and encoder pulses that came out shorter than the pulse or merged
+ * into one. Works offline on the capture file only.
+ *
+ *   usbmon [-d bus:dev] [-p pulse_ms] [-t tolerance_ms] <capture>
+ *
+ * The capture is either the text of /sys/kernel/debug/usb/usbmon/<bus>u or
+ * a pcap file as written by tcpdump -i usbmon<bus> or Wireshark (save as
+ * pcap, not pcapng). Reports are decoded with the 56 button descriptor of
+ * overrides/teensy4/usb_joystick_desc.h, JOYSTICK_SIZE 7; the first device
+ * sending reports of that size is taken unless -d picks one.
+ *
+ * A button is an encoder direction when most of its presses last the pulse
+ * (20 ms by default) give or take the tolerance, two 1 ms polling intervals
+ * by default. The exit status is 1 when any of its pulses collapsed.
+ * tools/captures holds a clean and a broken capture to try it on.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace desc {
+#define JOYSTICK_SIZE 7
+#include "usb_joystick_desc.h"
+#undef JOYSTICK_SIZE
+} // namespace desc
+
+namespace {
+
+const size_t REPORT_BYTES = 7;
+
+struct Report {
+  double us;
+  uint8_t data[REPORT_BYTES];
+};
+
+struct Capture {
+  std::vector<Report> reports;
+  std::string device; // bus:dev:ep of the reports
+  std::string error;
+};
+
+/**
+ * Bit of the report for every button, from the Input items of the
+ * descriptor on the button usage page.
+ */
+std::map<unsigned, unsigned> buttonBits(const uint8_t *p, size_t length) {
+  std::map<unsigned, unsigned> bits; // button -> bit
+  unsigned page = 0, size = 0, count = 0, usageMin = 0, offset = 0;
+  for (size_t i = 0; i < length;) {
+    uint8_t prefix = p[i++];
+    uint8_t n = prefix & 3;
+    n = n == 3 ? 4 : n;
+    uint32_t value = 0;
+    for (uint8_t k = 0; k < n && i + k < length; k++) {
+      value |= uint32_t(p[i + k]) << (8 * k);
+    }
+    i += n;
+    switch (prefix & 0xFC) {
+    case 0x04: page = value; break;
+    case 0x74: size = value; break;
+    case 0x94: count = value; break;
+    case 0x18: usageMin = value; break;
+    case 0x80: // input
+      for (unsigned k = 0; k < count && page == 0x09 && !(value & 1); k++) {
+        bits[usageMin + k] = offset + k * size;
+      }
+      offset += size * count;
+      usageMin = 0;
+      break;
+    }
+  }
+  return bits;
+}
+
+bool matches(const std::string &device, const std::string &want) {
+  return want.empty() || device.compare(0, want.size(), want) == 0;
+}
+
+void add(Capture &c, const std::string &device, const std::string &want,
+         double us, const uint8_t *data, size_t length) {
+  if (length != REPORT_BYTES || !matches(device, want)) {
+    return;
+  }
+  if (c.device.empty()) {
+    c.device = device;
+  } else if (c.device != device) {
+    return;
+  }
+  Report r;
+  r.us = us;
+  memcpy(r.data, data, REPORT_BYTES);
+  c.reports.push_back(r);
+}
+
+/**
+ * Text format, one URB event per line, see Documentation/usb/usbmon.rst:
+ *   tag timestamp C Ii:bus:dev:ep status:interval length = data words
+ */
+void readText(FILE *in, const std::string &want, Capture &c) {
+  char line[512];
+  double last = 0, base = 0;
+  while (fgets(line, sizeof(line), in)) {
+    char tag[32], type[4], addr[32], status[32];
+    unsigned long stamp;
+    unsigned length;
+    int used = 0;
+    if (sscanf(line, "%31s %lu %3s %31s %31s %u = %n", tag, &stamp, type, addr,
+               status, &length, &used) != 6 ||
+        !used || strcmp(type, "C") != 0 || strncmp(addr, "Ii:", 3) != 0) {
+      continue;
+    }
+    // the stamp is 32 bits of microseconds, it wraps after 71 minutes
+    double us = base + stamp;
+    if (us < last) {
+      base += 4294967296.0;
+      us += 4294967296.0;
+    }
+    last = us;
+
+    uint8_t data[64];
+    size_t n = 0;
+    for (const char *p = line + used; *p && n < sizeof(data);) {
+      if (*p == ' ' || *p == '\n') {
+        p++;
+        continue;
+      }
+      unsigned byte;
+      if (sscanf(p, "%2x", &byte) != 1) {
+        break;
+      }
+      data[n++] = byte;
+      p += 2;
+    }
+    if (n == length) {
+      add(c, addr + 3, want, us, data, n);
+    }
+  }
+}
+
+/**
+ * pcap with the usbmon link types, 189 (48 byte header) or 220 (64 bytes).
+ */
+void readPcap(FILE *in, const std::string &want, Capture &c) {
+  uint8_t global[24];
+  if (fread(global, 1, sizeof(global), in) != sizeof(global)) {
+    c.error = "short pcap header";
+    return;
+  }
+  uint32_t magic, linkType;
+  memcpy(&magic, global, 4);
+  memcpy(&linkType, global + 20, 4);
+  double tick = magic == 0xA1B23C4D ? 0.001 : 1; // nanosecond pcap
+  if (linkType != 189 && linkType != 220) {
+    c.error = "not a usbmon capture, link type " + std::to_string(linkType);
+    return;
+  }
+  size_t header = linkType == 220 ? 64 : 48;
+
+  uint8_t record[16];
+  std::vector<uint8_t> packet;
+  while (fread(record, 1, sizeof(record), in) == sizeof(record)) {
+    uint32_t sec, frac, length;
+    memcpy(&sec, record, 4);
+    memcpy(&frac, record + 4, 4);
+    memcpy(&length, record + 8, 4);
+    packet.resize(length);
+    if (fread(packet.data(), 1, length, in) != length) {
+      break;
+    }
+    if (length < header) {
+      continue;
+    }
+    const uint8_t *u = packet.data();
+    uint16_t bus;
+    uint32_t dataLength;
+    memcpy(&bus, u + 12, 2);
+    memcpy(&dataLength, u + 36, 4);
+    // completion of an interrupt IN transfer with its data captured
+    if (u[8] != 'C' || u[9] != 1 || !(u[10] & 0x80) || u[15] != 0 ||
+        header + dataLength > length) {
+      continue;
+    }
+    char device[32];
+    snprintf(device, sizeof(device), "%u:%03u:%u", bus, u[11], u[10] & 0x7F);
+    add(c, device, want, sec * 1e6 + frac * tick, u + header, dataLength);
+  }
+}
+
+double percentile(std::vector<double> v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, size_t(std::ceil(p * v.size())) - 1)];
+}
+
+int usage() {
+  fprintf(stderr, "usage: usbmon [-d bus:dev] [-p pulse_ms] "
+                  "[-t tolerance_ms] <capture>\n");
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string want;
+  double pulseMs = 20, tolerance = 2;
+  int opt;
+  while ((opt = getopt(argc, argv, "d:p:t:")) != -1) {
+    switch (opt) {
+    case 'd': {
+      // 1:4 and 1:004 both name device 4 on bus 1
+      unsigned bus, dev;
+      if (sscanf(optarg, "%u:%u", &bus, &dev) != 2) {
+        return usage();
+      }
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%u:%03u:", bus, dev);
+      want = buf;
+      break;
+    }
+    case 'p': pulseMs = atof(optarg); break;
+    case 't': tolerance = atof(optarg); break;
+    default: return usage();
+    }
+  }
+  if (optind >= argc) {
+    return usage();
+  }
+  FILE *in = fopen(argv[optind], "rb");
+  if (!in) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  Capture c;
+  uint32_t magic = 0;
+  if (fread(&magic, 1, 4, in) == 4 &&
+      (magic == 0xA1B2C3D4 || magic == 0xA1B23C4D)) {
+    rewind(in);
+    readPcap(in, want, c);
+  } else {
+    rewind(in);
+    readText(in, want, c);
+  }
+  fclose(in);
+  if (!c.error.empty()) {
+    fprintf(stderr, "%s\n", c.error.c_str());
+    return 1;
+  }
+  if (c.reports.size() < 2) {
+    fprintf(stderr, "no %zu byte joystick reports found\n", REPORT_BYTES);
+    return 1;
+  }
+
+  const std::vector<Report> &r = c.reports;
+  printf("device %s, %zu reports over %.3f s\n", c.device.c_str(), r.size(),
+         (r.back().us - r.front().us) / 1e6);
+
+  std::vector<double> intervals;
+  unsigned bins[24] = {};
+  for (size_t i = 1; i < r.size(); i++) {
+    double us = r[i].us - r[i - 1].us;
+    intervals.push_back(us);
+    unsigned b = us < 1 ? 0 : 1 + unsigned(std::log2(us));
+    bins[std::min(b, 23u)]++;
+  }
+  printf("intervals: min %.0f us, p50 %.0f us, p99 %.0f us, max %.0f us\n",
+         *std::min_element(intervals.begin(), intervals.end()),
+         percentile(intervals, 0.5), percentile(intervals, 0.99),
+         *std::max_element(intervals.begin(), intervals.end()));
+  for (unsigned b = 0; b < 24; b++) {
+    if (bins[b]) {
+      printf("  >= %7u us: %u\n", b ? 1u << (b - 1) : 0, bins[b]);
+    }
+  }
+
+  // press durations, a button held in the first report has no start
+  std::map<unsigned, unsigned> bits =
+      buttonBits(desc::joystick_report_desc, sizeof(desc::joystick_report_desc));
+  std::map<unsigned, double> downAt;
+  std::map<unsigned, std::vector<double>> held; // ms per press
+  for (size_t i = 1; i < r.size(); i++) {
+    for (const auto &b : bits) {
+      bool was = (r[i - 1].data[b.second / 8] >> (b.second % 8)) & 1;
+      bool is = (r[i].data[b.second / 8] >> (b.second % 8)) & 1;
+      if (is && !was) {
+        downAt[b.first] = r[i].us;
+      } else if (was && !is && downAt.count(b.first)) {
+        held[b.first].push_back((r[i].us - downAt[b.first]) / 1000);
+        downAt.erase(b.first);
+      }
+    }
+  }
+
+  unsigned long collapsed = 0;
+  printf("button presses   min ms   avg ms   max ms\n");
+  for (const auto &h : held) {
+    const std::vector<double> &v = h.second;
+    double sum = 0;
+    unsigned pulses = 0, shorter = 0, merged = 0;
+    for (double ms : v) {
+      sum += ms;
+      pulses += std::fabs(ms - pulseMs) <= tolerance;
+      shorter += ms < pulseMs - tolerance;
+      merged += ms > pulseMs + tolerance;
+    }
+    bool encoder = v.size() >= 3 && pulses * 2 > v.size();
+    printf("%6u %7zu %8.1f %8.1f %8.1f%s\n", h.first, v.size(),
+           *std::min_element(v.begin(), v.end()), sum / v.size(),
+           *std::max_element(v.begin(), v.end()), encoder ? "  encoder" : "");
+    if (encoder && (shorter || merged)) {
+      printf("       collapsed pulses: %u shorter than %.0f ms, %u merged\n",
+             shorter, pulseMs - tolerance, merged);
+      collapsed += shorter + merged;
+    }
+  }
+  if (!downAt.empty()) {
+    printf("%zu buttons still held at the end\n", downAt.size());
+  }
+  return collapsed ? 1 : 0;
+}